@@ -52,7 +52,7 @@ namespace Cbpp {
 		if(m_keep_alive_timer){
 			return;
 		}
-		const AUTO(keep_alive_timeout, MainConfig::get<boost::uint64_t>("cbpp_keep_alive_timeout", 30000));
+		const AUTO(keep_alive_timeout, MainConfig::get_snapshot().cbpp_keep_alive_timeout);
 		m_keep_alive_timer = TimerDaemon::register_low_level_timer(0, keep_alive_timeout / 2,
 			boost::bind(&keep_alive_timer_proc, virtual_weak_from_this<LowLevelClient>(), _2, _3));
 	}
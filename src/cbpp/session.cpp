@@ -93,7 +93,7 @@ namespace Cbpp {
 			LOG_POSEIDON_DEBUG("Dispatching message: message_id = ", m_message_id, ", payload_len = ", m_payload.size());
 			session->on_sync_data_message(m_message_id, STD_MOVE(m_payload));
 
-			const AUTO(keep_alive_timeout, MainConfig::get<boost::uint64_t>("cbpp_keep_alive_timeout", 30000));
+			const AUTO(keep_alive_timeout, MainConfig::get_snapshot().cbpp_keep_alive_timeout);
 			session->set_timeout(keep_alive_timeout);
 		}
 	};
@@ -118,14 +118,14 @@ namespace Cbpp {
 			LOG_POSEIDON_DEBUG("Dispatching control message: status_code = ", m_status_code, ", param = ", m_param);
 			session->on_sync_control_message(m_status_code, STD_MOVE(m_param));
 
-			const AUTO(keep_alive_timeout, MainConfig::get<boost::uint64_t>("cbpp_keep_alive_timeout", 30000));
+			const AUTO(keep_alive_timeout, MainConfig::get_snapshot().cbpp_keep_alive_timeout);
 			session->set_timeout(keep_alive_timeout);
 		}
 	};
 
 	Session::Session(UniqueFile socket)
 		: LowLevelSession(STD_MOVE(socket))
-		, m_max_request_length(MainConfig::get<boost::uint64_t>("cbpp_max_request_length", 16384))
+		, m_max_request_length(MainConfig::get_snapshot().cbpp_max_request_length)
 		, m_size_total(0), m_message_id(0), m_payload()
 	{
 	}
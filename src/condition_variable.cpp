@@ -6,6 +6,7 @@
 #include <boost/static_assert.hpp>
 #include <pthread.h>
 #include <time.h>
+#include <limits>
 #include "log.hpp"
 #include "system_exception.hpp"
 
@@ -57,6 +58,11 @@ bool ConditionVariable::timed_wait(Mutex::UniqueLock &lock, unsigned long long m
 		LOG_POSEIDON_ERROR("::clock_gettime() failed with error code ", err);
 		DEBUG_THROW(SystemException, err);
 	}
+	// 超时时间过长会导致 tv_sec 溢出，此时视为无限等待。
+	if(ms / 1000 >= static_cast<unsigned long long>(std::numeric_limits<std::time_t>::max() - tp.tv_sec - 1)){
+		wait(lock);
+		return true;
+	}
 	tp.tv_sec += static_cast<std::time_t>(ms / 1000);
 	tp.tv_nsec += static_cast<long>(ms % 1000 * 1000000);
 	if(tp.tv_nsec >= 1000000000){
@@ -214,7 +214,7 @@ namespace Http {
 				LOG_POSEIDON_WARNING("> Nonce timestamp is in the future.");
 				return std::make_pair(AUTH_EXPIRED, NULLPTR);
 			}
-			const AUTO(nonce_expiry_time, MainConfig::get<boost::uint64_t>("http_digest_nonce_expiry_time", 60000));
+			const AUTO(nonce_expiry_time, MainConfig::get_snapshot().http_digest_nonce_expiry_time);
 			if(local_now - raw_nonce.timestamp > nonce_expiry_time){
 				LOG_POSEIDON_WARNING("> Nonce has expired.");
 				return std::make_pair(AUTH_EXPIRED, NULLPTR);
@@ -54,7 +54,7 @@ namespace Http {
 				}
 				if(lf_offset == static_cast<std::size_t>(-1)){
 					// 没找到换行符。
-					const AUTO(max_line_length, MainConfig::get<std::size_t>("http_max_header_line_length", 8192));
+					const AUTO(max_line_length, MainConfig::get_snapshot().http_max_header_line_length);
 					if(m_queue.size() > max_line_length){
 						LOG_POSEIDON_WARNING("HTTP header line is too long: size = ", m_queue.size());
 						DEBUG_THROW(Exception, ST_BAD_REQUEST); // XXX 用一个别的状态码？
@@ -146,7 +146,7 @@ namespace Http {
 			case S_HEADERS:
 				if(!expected.empty()){
 					const AUTO(headers, m_request_headers.headers.size());
-					const AUTO(max_headers, MainConfig::get<std::size_t>("http_max_headers_per_request", 64));
+					const AUTO(max_headers, MainConfig::get_snapshot().http_max_headers_per_request);
 					if(headers >= max_headers){
 						LOG_POSEIDON_WARNING("Too many HTTP headers: headers = ", headers);
 						DEBUG_THROW(Exception, ST_BAD_REQUEST); // XXX 用一个别的状态码？
@@ -14,16 +14,6 @@
 
 namespace Poseidon {
 
-namespace {
-	boost::uint64_t config_get_max_request_length(){
-		AUTO(max_request_length, MainConfig::get<boost::uint64_t>("http_max_request_length", 16384));
-		if(max_request_length < 1){
-			max_request_length = 1;
-		}
-		return max_request_length;
-	}
-}
-
 namespace Http {
 	class Session::SyncJobBase : public JobBase {
 	private:
@@ -136,7 +126,7 @@ namespace Http {
 			session->on_sync_request(STD_MOVE(m_request_headers), STD_MOVE(m_entity));
 
 			if(m_keep_alive){
-				const AUTO(keep_alive_timeout, MainConfig::get<boost::uint64_t>("http_keep_alive_timeout", 5000));
+				const AUTO(keep_alive_timeout, MainConfig::get_snapshot().http_keep_alive_timeout);
 				session->set_timeout(keep_alive_timeout);
 			} else {
 				session->shutdown_write();
@@ -146,7 +136,7 @@ namespace Http {
 
 	Session::Session(UniqueFile socket)
 		: LowLevelSession(STD_MOVE(socket))
-		, m_max_request_length(config_get_max_request_length()), m_size_total(0), m_request_headers()
+		, m_max_request_length(MainConfig::get_snapshot().http_max_request_length), m_size_total(0), m_request_headers()
 	{
 	}
 	Session::~Session(){
@@ -10,12 +10,28 @@
 namespace Poseidon {
 
 JobPromise::JobPromise() NOEXCEPT
-	: m_satisfied(false), m_except()
+	: m_satisfied(false), m_waited(false), m_except()
 {
 }
 JobPromise::~JobPromise(){
 }
 
+bool JobPromise::check_and_mark_waited() const NOEXCEPT {
+	const RecursiveMutex::UniqueLock lock(m_mutex);
+	if(m_satisfied){
+		return true;
+	}
+	m_waited = true;
+	return false;
+}
+void JobPromise::notify_waiters() const {
+	if(!m_waited){
+		return;
+	}
+	m_waited = false;
+	JobDispatcher::wake_fibers(this);
+}
+
 bool JobPromise::would_throw() const NOEXCEPT {
 	const RecursiveMutex::UniqueLock lock(m_mutex);
 	if(!m_satisfied){
@@ -47,6 +63,7 @@ void JobPromise::set_success(){
 	}
 	m_satisfied = true;
 //	m_except = VAL_INIT;
+	notify_waiters();
 }
 #ifdef POSEIDON_CXX11
 void JobPromise::set_exception(std::exception_ptr except)
@@ -60,6 +77,7 @@ void JobPromise::set_exception(boost::exception_ptr except)
 	}
 	m_satisfied = true;
 	m_except = STD_MOVE_IDN(except);
+	notify_waiters();
 }
 
 void yield(const boost::shared_ptr<const JobPromise> &promise, bool insignificant){
@@ -21,6 +21,7 @@ class JobPromise : NONCOPYABLE {
 protected:
 	mutable RecursiveMutex m_mutex;
 	bool m_satisfied;
+	mutable bool m_waited; // 有纤程在等待，被满足时需要通知 JobDispatcher。
 #ifdef POSEIDON_CXX11
 	std::exception_ptr m_except;
 #else
@@ -31,7 +32,13 @@ public:
 	JobPromise() NOEXCEPT;
 	virtual ~JobPromise();
 
+private:
+	void notify_waiters() const;
+
 public:
+	// 由 JobDispatcher 调用。返回 true 若已被满足，否则标记为有纤程在等待。
+	bool check_and_mark_waited() const NOEXCEPT;
+
 	bool is_satisfied() const NOEXCEPT {
 		const RecursiveMutex::UniqueLock lock(m_mutex);
 		return m_satisfied;
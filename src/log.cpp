@@ -3,11 +3,19 @@
 
 #include "precompiled.hpp"
 #include "log.hpp"
+#include <vector>
 #include <unistd.h>
 #include <pthread.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include "atomic.hpp"
 #include "time.hpp"
 #include "flags.hpp"
+#include "thread.hpp"
+#include "system_exception.hpp"
 #include "singletons/main_config.hpp"
 
 namespace Poseidon {
@@ -41,6 +49,489 @@ namespace {
 	}
 
 	__thread char t_tag[5] = "----";
+
+	enum {
+		DEST_STDOUT,
+		DEST_STDERR,
+		DEST_FILE,
+	};
+
+	// 日志文件，受 g_mutex 保护。
+	int g_file_fd = -1;
+	boost::uint64_t g_file_size = 0;
+	boost::uint64_t g_file_next_rotation = 0;
+
+	volatile bool g_file_enabled = false;
+	std::string g_file_path;
+	boost::uint64_t g_file_max_size = 0;
+	boost::uint64_t g_file_rotate_interval = 0;
+
+	// 调用时必须持有 g_mutex。
+	int get_dest_fd(unsigned dest) NOEXCEPT {
+		if(dest == DEST_FILE){
+			if(g_file_fd >= 0){
+				return g_file_fd;
+			}
+			return STDERR_FILENO;
+		}
+		return (dest == DEST_STDERR) ? STDERR_FILENO : STDOUT_FILENO;
+	}
+
+	// 调用时必须持有 g_mutex。
+	void write_iovecs(unsigned dest, ::iovec *iov, unsigned count) NOEXCEPT {
+		const int fd = get_dest_fd(dest);
+		while(count != 0){
+			const ::ssize_t result = ::writev(fd, iov, static_cast<int>(count));
+			if(result < 0){
+				if(errno == EINTR){
+					continue;
+				}
+				break;
+			}
+			if(fd == g_file_fd){
+				g_file_size += static_cast<boost::uint64_t>(result);
+			}
+			std::size_t bytes_rem = static_cast<std::size_t>(result);
+			while((count != 0) && (bytes_rem >= iov->iov_len)){
+				bytes_rem -= iov->iov_len;
+				++iov;
+				--count;
+			}
+			if(count != 0){
+				iov->iov_base = static_cast<char *>(iov->iov_base) + bytes_rem;
+				iov->iov_len -= bytes_rem;
+			}
+		}
+	}
+	void write_line_synchronously(unsigned dest, const std::string &line) NOEXCEPT {
+		::iovec iov;
+		iov.iov_base = const_cast<char *>(line.data());
+		iov.iov_len = line.size();
+
+		int err_code = ::pthread_mutex_lock(&g_mutex);
+		(void)err_code;
+		assert(err_code == 0);
+		write_iovecs(dest, &iov, 1);
+		err_code = ::pthread_mutex_unlock(&g_mutex);
+		assert(err_code == 0);
+	}
+
+	int open_log_file(const std::string &path){
+		const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+		if(fd < 0){
+			return -1;
+		}
+		struct ::stat stat_buf;
+		if(::fstat(fd, &stat_buf) == 0){
+			g_file_size = static_cast<boost::uint64_t>(stat_buf.st_size);
+		} else {
+			g_file_size = 0;
+		}
+		return fd;
+	}
+	// 调用时必须持有 g_mutex。
+	void check_log_file_rotation(){
+		if(g_file_path.empty()){
+			return;
+		}
+		const AUTO(now, get_fast_mono_clock());
+		bool rotate = false;
+		if((g_file_max_size != 0) && (g_file_size >= g_file_max_size)){
+			rotate = true;
+		}
+		if((g_file_rotate_interval != 0) && (now >= g_file_next_rotation)){
+			g_file_next_rotation = now + g_file_rotate_interval;
+			rotate = true;
+		}
+		if(g_file_fd < 0){
+			// 上次打开失败，重试。
+			g_file_fd = open_log_file(g_file_path);
+			return;
+		}
+		if(!rotate || (g_file_size == 0)){
+			return;
+		}
+
+		char temp[256];
+		const std::size_t len = format_time(temp, sizeof(temp), get_local_time(), true);
+		std::string new_path;
+		new_path.reserve(g_file_path.size() + len + 1);
+		new_path += g_file_path;
+		new_path += '.';
+		for(std::size_t i = 0; i < len; ++i){
+			new_path += (temp[i] == ' ') ? '_' : temp[i];
+		}
+		::close(g_file_fd);
+		g_file_fd = -1;
+		if(::rename(g_file_path.c_str(), new_path.c_str()) != 0){
+			const int err_code = errno;
+			std::sprintf(temp, "Failed to rotate log file, errno = %d\n", err_code);
+			::write(STDERR_FILENO, temp, std::strlen(temp));
+		}
+		g_file_fd = open_log_file(g_file_path);
+		if(g_file_fd < 0){
+			const int err_code = errno;
+			std::sprintf(temp, "Failed to reopen log file, errno = %d\n", err_code);
+			::write(STDERR_FILENO, temp, std::strlen(temp));
+		}
+	}
+
+	// 每个线程一个单生产者单消费者的环形缓冲区。
+	// 每条记录由 RecordHeader 和格式化好的一行组成，可以跨越缓冲区末尾。
+	struct RecordHeader {
+		boost::uint32_t size;
+		boost::uint32_t dest;
+	};
+
+	struct LogRing : NONCOPYABLE {
+		const std::size_t capacity; // 二的幂。
+		char *const data;
+
+		volatile std::size_t read_offset;  // 只由消费者修改。
+		volatile std::size_t write_offset; // 只由所属线程修改。
+		volatile unsigned long dropped;
+		bool orphaned; // 所属线程已退出。受 g_ring_mutex 保护。
+
+		explicit LogRing(std::size_t capacity_)
+			: capacity(capacity_), data(static_cast<char *>(::operator new(capacity_)))
+			, read_offset(0), write_offset(0), dropped(0), orphaned(false)
+		{
+		}
+		~LogRing(){
+			::operator delete(data);
+		}
+
+		void copy_in(std::size_t offset, const void *src, std::size_t size) NOEXCEPT {
+			const std::size_t begin = offset & (capacity - 1);
+			const std::size_t first = std::min(size, capacity - begin);
+			std::memcpy(data + begin, src, first);
+			std::memcpy(data, static_cast<const char *>(src) + first, size - first);
+		}
+		void copy_out(void *dst, std::size_t offset, std::size_t size) const NOEXCEPT {
+			const std::size_t begin = offset & (capacity - 1);
+			const std::size_t first = std::min(size, capacity - begin);
+			std::memcpy(dst, data + begin, first);
+			std::memcpy(static_cast<char *>(dst) + first, data, size - first);
+		}
+		// 返回添加的 iovec 数量，最多两个。
+		unsigned map(::iovec *iov, std::size_t offset, std::size_t size) const NOEXCEPT {
+			const std::size_t begin = offset & (capacity - 1);
+			const std::size_t first = std::min(size, capacity - begin);
+			iov[0].iov_base = data + begin;
+			iov[0].iov_len = first;
+			if(first == size){
+				return 1;
+			}
+			iov[1].iov_base = data;
+			iov[1].iov_len = size - first;
+			return 2;
+		}
+	};
+
+	// 不要使用 Mutex 对象，理由同上。锁的顺序是 g_drain_mutex、g_ring_mutex 然后 g_mutex。
+	// g_drain_mutex 保证同一时刻只有一个消费者，输出时不持有 g_ring_mutex，因此不会阻塞生产者。
+	::pthread_mutex_t g_drain_mutex = PTHREAD_MUTEX_INITIALIZER;
+	::pthread_mutex_t g_ring_mutex = PTHREAD_MUTEX_INITIALIZER;
+	::pthread_cond_t g_writer_cond = PTHREAD_COND_INITIALIZER;
+	std::vector<LogRing *> g_rings;
+	std::vector<LogRing *> g_drain_snapshot; // 受 g_drain_mutex 保护。
+	bool g_writer_active = false;
+	bool g_writer_quitting = false;
+	Thread g_writer_thread;
+
+	volatile bool g_async_running = false;
+	volatile unsigned long g_pushing_count = 0; // 看到 g_async_running 为 true 之后正在写入环形缓冲区的线程数。
+	volatile bool g_writer_sleeping = false;
+	std::size_t g_ring_capacity = 0;
+	bool g_overflow_blocks = false;
+
+	::pthread_once_t g_ring_key_once = PTHREAD_ONCE_INIT;
+	::pthread_key_t g_ring_key;
+
+	__thread LogRing *t_ring;
+	__thread bool t_is_writer;
+	// 当前线程正在写入自己的环形缓冲区，或者持有 g_ring_mutex。
+	// 此时信号处理函数中输出的日志必须同步写入，否则会破坏环形缓冲区或者死锁。
+	__thread volatile unsigned t_ring_depth;
+
+	void lock_rings() NOEXCEPT {
+		++t_ring_depth;
+		const int err_code = ::pthread_mutex_lock(&g_ring_mutex);
+		(void)err_code;
+		assert(err_code == 0);
+	}
+	void unlock_rings() NOEXCEPT {
+		const int err_code = ::pthread_mutex_unlock(&g_ring_mutex);
+		(void)err_code;
+		assert(err_code == 0);
+		--t_ring_depth;
+	}
+	void lock_drain() NOEXCEPT {
+		++t_ring_depth;
+		const int err_code = ::pthread_mutex_lock(&g_drain_mutex);
+		(void)err_code;
+		assert(err_code == 0);
+	}
+	void unlock_drain() NOEXCEPT {
+		const int err_code = ::pthread_mutex_unlock(&g_drain_mutex);
+		(void)err_code;
+		assert(err_code == 0);
+		--t_ring_depth;
+	}
+	void wake_writer() NOEXCEPT {
+		lock_rings();
+		::pthread_cond_signal(&g_writer_cond);
+		unlock_rings();
+	}
+
+	// 调用时必须持有 g_drain_mutex。返回是否输出了任何数据。
+	bool drain_ring(LogRing *ring) NOEXCEPT {
+		bool written = false;
+
+		const unsigned long dropped = atomic_exchange(ring->dropped, 0ul, ATOMIC_RELAXED);
+		if(dropped != 0){
+			char temp[256];
+			::iovec iov;
+			iov.iov_base = temp;
+			iov.iov_len = (unsigned)std::sprintf(temp, "(%lu log line(s) dropped because the buffer was full)\n", dropped);
+
+			int err_code = ::pthread_mutex_lock(&g_mutex);
+			(void)err_code;
+			assert(err_code == 0);
+			write_iovecs(atomic_load(g_file_enabled, ATOMIC_RELAXED) ? DEST_FILE : DEST_STDERR, &iov, 1);
+			err_code = ::pthread_mutex_unlock(&g_mutex);
+			assert(err_code == 0);
+			written = true;
+		}
+
+		std::size_t committed = ring->read_offset;
+		const std::size_t write_offset = atomic_load(ring->write_offset, ATOMIC_ACQUIRE);
+		if(committed == write_offset){
+			return written;
+		}
+
+		::iovec iov[64];
+		unsigned count = 0;
+		unsigned dest = 0;
+		std::size_t offset = committed;
+		for(;;){
+			bool flush = (offset == write_offset);
+			RecordHeader header;
+			if(!flush){
+				ring->copy_out(&header, offset, sizeof(header));
+				flush = (count != 0) && ((header.dest != dest) || (count + 2 > COUNT_OF(iov)));
+			}
+			if(flush){
+				int err_code = ::pthread_mutex_lock(&g_mutex);
+				(void)err_code;
+				assert(err_code == 0);
+				write_iovecs(dest, iov, count);
+				err_code = ::pthread_mutex_unlock(&g_mutex);
+				assert(err_code == 0);
+				count = 0;
+
+				committed = offset;
+				atomic_store(ring->read_offset, committed, ATOMIC_RELEASE);
+				if(offset == write_offset){
+					break;
+				}
+			}
+			dest = header.dest;
+			count += ring->map(iov + count, offset + sizeof(header), header.size);
+			offset += sizeof(header) + header.size;
+		}
+		return true;
+	}
+	// 调用时必须持有 g_drain_mutex，不能持有 g_ring_mutex。
+	bool drain_all_rings() NOEXCEPT {
+		bool written = false;
+
+		// 环形缓冲区只在这里释放，因此在 g_drain_mutex 的保护下，复制出来的指针一直有效。
+		lock_rings();
+		bool copied = true;
+		try {
+			g_drain_snapshot = g_rings;
+		} catch(std::bad_alloc &){
+			copied = false;
+		}
+		if(!copied){
+			// 内存不足时在锁内输出。
+			for(AUTO(it, g_rings.begin()); it != g_rings.end(); ++it){
+				if(drain_ring(*it)){
+					written = true;
+				}
+			}
+		}
+		unlock_rings();
+		if(copied){
+			for(AUTO(it, g_drain_snapshot.begin()); it != g_drain_snapshot.end(); ++it){
+				if(drain_ring(*it)){
+					written = true;
+				}
+			}
+		}
+
+		lock_rings();
+		AUTO(it, g_rings.begin());
+		while(it != g_rings.end()){
+			LogRing *const ring = *it;
+			if(ring->orphaned && (ring->read_offset == atomic_load(ring->write_offset, ATOMIC_ACQUIRE))){
+				delete ring;
+				it = g_rings.erase(it);
+				continue;
+			}
+			++it;
+		}
+		unlock_rings();
+		return written;
+	}
+	// 调用时必须持有 g_ring_mutex。
+	bool has_pending_records() NOEXCEPT {
+		for(AUTO(it, g_rings.begin()); it != g_rings.end(); ++it){
+			const AUTO(ring, *it);
+			if((ring->read_offset != atomic_load(ring->write_offset, ATOMIC_SEQ_CST)) || (atomic_load(ring->dropped, ATOMIC_RELAXED) != 0)){
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void writer_thread_proc(){
+		t_is_writer = true;
+
+		for(;;){
+			lock_drain();
+			const bool written = drain_all_rings();
+
+			int err_code = ::pthread_mutex_lock(&g_mutex);
+			(void)err_code;
+			assert(err_code == 0);
+			check_log_file_rotation();
+			err_code = ::pthread_mutex_unlock(&g_mutex);
+			assert(err_code == 0);
+			unlock_drain();
+
+			if(written){
+				continue;
+			}
+			lock_rings();
+			if(g_writer_quitting){
+				unlock_rings();
+				break;
+			}
+			// 生产者先写 write_offset 再读 g_writer_sleeping，这里顺序相反，因此不会丢失唤醒。
+			atomic_store(g_writer_sleeping, true, ATOMIC_SEQ_CST);
+			if(!has_pending_records()){
+				::timespec tp;
+				::clock_gettime(CLOCK_REALTIME, &tp);
+				tp.tv_sec += 1;
+				::pthread_cond_timedwait(&g_writer_cond, &g_ring_mutex, &tp);
+			}
+			atomic_store(g_writer_sleeping, false, ATOMIC_RELAXED);
+			unlock_rings();
+		}
+	}
+
+	void ring_key_destructor(void *param) NOEXCEPT {
+		LogRing *const ring = static_cast<LogRing *>(param);
+		t_ring = NULLPTR;
+
+		lock_rings();
+		ring->orphaned = true;
+		const bool writer_active = g_writer_active;
+		if(writer_active){
+			// 由写入线程输出剩余的日志并释放。
+			::pthread_cond_signal(&g_writer_cond);
+		}
+		unlock_rings();
+		if(!writer_active){
+			lock_drain();
+			drain_all_rings();
+			unlock_drain();
+		}
+	}
+	void create_ring_key() NOEXCEPT {
+		const int err_code = ::pthread_key_create(&g_ring_key, &ring_key_destructor);
+		if(err_code != 0){
+			std::abort();
+		}
+	}
+
+	LogRing *require_thread_ring() NOEXCEPT {
+		LogRing *ring = t_ring;
+		if(!ring){
+			try {
+				ring = new LogRing(g_ring_capacity);
+			} catch(std::bad_alloc &){
+				return NULLPTR;
+			}
+			lock_rings();
+			try {
+				g_rings.push_back(ring);
+			} catch(std::bad_alloc &){
+				unlock_rings();
+				delete ring;
+				return NULLPTR;
+			}
+			unlock_rings();
+			::pthread_setspecific(g_ring_key, ring);
+			t_ring = ring;
+		}
+		return ring;
+	}
+
+	bool do_push_line(unsigned dest, const std::string &line) NOEXCEPT {
+		LogRing *const ring = require_thread_ring();
+		if(!ring){
+			return false;
+		}
+		const std::size_t size_needed = sizeof(RecordHeader) + line.size();
+		if(size_needed > ring->capacity){
+			return false;
+		}
+
+		const std::size_t write_offset = ring->write_offset;
+		for(;;){
+			const std::size_t read_offset = atomic_load(ring->read_offset, ATOMIC_ACQUIRE);
+			if(ring->capacity - (write_offset - read_offset) >= size_needed){
+				break;
+			}
+			if(!g_overflow_blocks){
+				atomic_add(ring->dropped, 1ul, ATOMIC_RELAXED);
+				return true;
+			}
+			wake_writer();
+			if(!atomic_load(g_async_running, ATOMIC_ACQUIRE)){
+				return false;
+			}
+			::timespec req;
+			req.tv_sec = 0;
+			req.tv_nsec = 1000000;
+			::nanosleep(&req, NULLPTR);
+		}
+
+		RecordHeader header;
+		header.size = static_cast<boost::uint32_t>(line.size());
+		header.dest = dest;
+		ring->copy_in(write_offset, &header, sizeof(header));
+		ring->copy_in(write_offset + sizeof(header), line.data(), line.size());
+		atomic_store(ring->write_offset, write_offset + size_needed, ATOMIC_SEQ_CST);
+
+		if(atomic_load(g_writer_sleeping, ATOMIC_SEQ_CST)){
+			wake_writer();
+		}
+		return true;
+	}
+	// 返回 false 表示应该同步写入。
+	bool push_line(unsigned dest, const std::string &line) NOEXCEPT {
+		if(t_is_writer || (t_ring_depth != 0)){
+			return false;
+		}
+		++t_ring_depth;
+		const bool pushed = do_push_line(dest, line);
+		--t_ring_depth;
+		return pushed;
+	}
 }
 
 boost::uint64_t Logger::get_mask() NOEXCEPT {
@@ -96,13 +587,16 @@ Logger::~Logger() NOEXCEPT {
 
 	try {
 		bool use_ascii_colors;
-		int fd;
-		if(m_mask & SP_MAJOR){
+		unsigned dest;
+		if(atomic_load(g_file_enabled, ATOMIC_ACQUIRE)){
+			use_ascii_colors = false;
+			dest = DEST_FILE;
+		} else if(m_mask & SP_MAJOR){
 			use_ascii_colors = stderr_uses_ascii_colors;
-			fd = STDERR_FILENO;
+			dest = DEST_STDERR;
 		} else {
 			use_ascii_colors = stdout_uses_ascii_colors;
-			fd = STDOUT_FILENO;
+			dest = DEST_STDOUT;
 		}
 
 		AUTO_REF(level_elem, LEVEL_ELEMENTS[__builtin_ctz(m_mask | LV_TRACE)]);
@@ -150,13 +644,17 @@ Logger::~Logger() NOEXCEPT {
 		}
 		line += ' ';
 
-		StreamBuffer buffer = STD_MOVE(m_stream.get_buffer());
-		int ch;
-		while((ch = buffer.get()) >= 0){
-			if((ch + 1 <= 0x20) || (ch == 0x7F)){
-				ch = ' ';
+		const StreamBuffer &buffer = m_stream.get_buffer();
+		line.reserve(line.size() + buffer.size() + 256);
+		for(AUTO(ce, buffer.get_const_chunk_enumerator()); ce; ++ce){
+			const std::size_t pos = line.size();
+			line.append(reinterpret_cast<const char *>(ce.data()), ce.size());
+			for(AUTO(it, line.begin() + static_cast<std::ptrdiff_t>(pos)); it != line.end(); ++it){
+				const unsigned ch = static_cast<unsigned char>(*it);
+				if((ch < 0x20) || (ch == 0x7F)){
+					*it = ' ';
+				}
 			}
-			line.push_back((char)ch);
 		}
 		line += ' ';
 
@@ -173,27 +671,142 @@ Logger::~Logger() NOEXCEPT {
 		}
 		line += '\n';
 
+		if((m_mask & 0x3F) == (LV_FATAL & 0x3F)){
+			// 程序可能马上终止，先把缓冲区里的日志写出去。
+			if(!t_is_writer && (t_ring_depth == 0) && atomic_load(g_async_running, ATOMIC_ACQUIRE)){
+				lock_drain();
+				drain_all_rings();
+				unlock_drain();
+			}
+		} else {
+			// 先增加计数再检查标志，这样 stop() 在清除标志之后等待计数归零，就能输出所有已经写入的日志。
+			atomic_add(g_pushing_count, 1ul, ATOMIC_SEQ_CST);
+			const bool pushed = atomic_load(g_async_running, ATOMIC_SEQ_CST) && push_line(dest, line);
+			atomic_sub(g_pushing_count, 1ul, ATOMIC_RELEASE);
+			if(pushed){
+				return;
+			}
+		}
+		write_line_synchronously(dest, line);
+	} catch(...){
+	}
+}
+
+void Logger::start(){
+	if(!MainConfig::get<bool>("log_async", true)){
+		LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO, "Asynchronous logging is disabled.");
+		return;
+	}
+	LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO, "Starting asynchronous log writer...");
+
+	std::size_t capacity = 4096;
+	const AUTO(buffer_size, MainConfig::get<std::size_t>("log_buffer_size", 262144));
+	while(capacity < buffer_size){
+		capacity <<= 1;
+	}
+	const AUTO(overflow_policy, MainConfig::get<std::string>("log_overflow_policy", "drop"));
+	bool overflow_blocks;
+	if(overflow_policy == "drop"){
+		overflow_blocks = false;
+	} else if(overflow_policy == "block"){
+		overflow_blocks = true;
+	} else {
+		LOG_POSEIDON_ERROR("Invalid log_overflow_policy: ", overflow_policy);
+		DEBUG_THROW(Exception, sslit("Invalid log_overflow_policy"));
+	}
+	const AUTO(file_path, MainConfig::get<std::string>("log_file_path"));
+	const AUTO(file_max_size, MainConfig::get<boost::uint64_t>("log_file_max_size", 0));
+	const AUTO(file_rotate_interval, MainConfig::get<boost::uint64_t>("log_file_rotate_interval", 0));
+	LOG_POSEIDON_DEBUG("Log buffer size = ", capacity, ", overflow policy = ", overflow_policy,
+		", file path = ", file_path, ", max size = ", file_max_size, ", rotate interval = ", file_rotate_interval);
+
+	::pthread_once(&g_ring_key_once, &create_ring_key);
+
+	if(!file_path.empty()){
 		int err_code = ::pthread_mutex_lock(&g_mutex);
 		(void)err_code;
 		assert(err_code == 0);
-		try {
-			std::size_t bytes_total = 0;
-			while(bytes_total < line.size()){
-				const AUTO(bytes_written, ::write(fd, line.data() + bytes_total, line.size() - bytes_total)); // noexcept
-				if(bytes_written <= 0){
-					break;
-				}
-				bytes_total += static_cast<std::size_t>(bytes_written);
-			}
-			err_code = ::pthread_mutex_unlock(&g_mutex);
-			assert(err_code == 0);
-		} catch(...){
-			err_code = ::pthread_mutex_unlock(&g_mutex);
-			assert(err_code == 0);
-			throw;
+		const int fd = open_log_file(file_path);
+		const int open_err_code = errno;
+		if(fd >= 0){
+			g_file_fd = fd;
+			g_file_path = file_path;
+			g_file_max_size = file_max_size;
+			g_file_rotate_interval = file_rotate_interval;
+			g_file_next_rotation = get_fast_mono_clock() + file_rotate_interval;
 		}
+		err_code = ::pthread_mutex_unlock(&g_mutex);
+		assert(err_code == 0);
+		if(fd < 0){
+			LOG_POSEIDON_ERROR("Could not open log file: file_path = ", file_path, ", err_code = ", open_err_code);
+			DEBUG_THROW(SystemException, open_err_code);
+		}
+		LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO, "Logs will be written to ", file_path);
+	}
+
+	lock_rings();
+	g_ring_capacity = capacity;
+	g_overflow_blocks = overflow_blocks;
+	g_writer_quitting = false;
+	g_writer_active = true;
+	unlock_rings();
+	try {
+		Thread(writer_thread_proc, "  L ").swap(g_writer_thread);
 	} catch(...){
+		lock_rings();
+		g_writer_active = false;
+		unlock_rings();
+		throw;
+	}
+	if(!file_path.empty()){
+		atomic_store(g_file_enabled, true, ATOMIC_RELEASE);
+	}
+	atomic_store(g_async_running, true, ATOMIC_RELEASE);
+}
+void Logger::stop() NOEXCEPT {
+	lock_rings();
+	const bool active = g_writer_active;
+	g_writer_quitting = true;
+	::pthread_cond_signal(&g_writer_cond);
+	unlock_rings();
+	if(!active){
+		return;
+	}
+	LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO, "Stopping asynchronous log writer...");
+
+	// 之后的日志同步写入。
+	atomic_store(g_async_running, false, ATOMIC_SEQ_CST);
+	try {
+		g_writer_thread.join();
+	} catch(...){
+		std::abort();
+	}
+	// 等待已经看到标志的生产者写完，再输出最后一次。
+	while(atomic_load(g_pushing_count, ATOMIC_SEQ_CST) != 0){
+		::timespec req;
+		req.tv_sec = 0;
+		req.tv_nsec = 1000000;
+		::nanosleep(&req, NULLPTR);
+	}
+
+	lock_rings();
+	g_writer_active = false;
+	unlock_rings();
+	lock_drain();
+	drain_all_rings();
+	unlock_drain();
+
+	int err_code = ::pthread_mutex_lock(&g_mutex);
+	(void)err_code;
+	assert(err_code == 0);
+	atomic_store(g_file_enabled, false, ATOMIC_RELEASE);
+	if(g_file_fd >= 0){
+		::close(g_file_fd);
+		g_file_fd = -1;
 	}
+	g_file_path.clear();
+	err_code = ::pthread_mutex_unlock(&g_mutex);
+	assert(err_code == 0);
 }
 
 void Logger::put(bool val){
@@ -33,6 +33,11 @@ public:
 	static bool initialize_mask_from_config();
 	static void finalize_mask() NOEXCEPT;
 
+	// 启动后日志由各线程写入自己的环形缓冲区，再由后台线程批量输出。
+	// 启动之前、停止之后以及 LV_FATAL 的日志都是同步写入的。
+	static void start();
+	static void stop() NOEXCEPT;
+
 	static const char *get_thread_tag() NOEXCEPT;
 	static void set_thread_tag(const char *new_tag) NOEXCEPT;
 
@@ -169,6 +169,7 @@ int main(int argc, char **argv){
 		MainConfig::set_run_path((1 < argc) ? argv[1] : "/usr/etc/poseidon");
 		MainConfig::reload();
 
+		START(Logger);
 		START(ProfileDepository);
 
 		run();
@@ -37,6 +37,15 @@ namespace MySql {
 			}
 		};
 
+		struct StatementCloser {
+			CONSTEXPR ::MYSQL_STMT *operator()() const NOEXCEPT {
+				return NULLPTR;
+			}
+			void operator()(::MYSQL_STMT *stmt) const NOEXCEPT {
+				::mysql_stmt_close(stmt);
+			}
+		};
+
 		struct FieldComparator {
 			bool operator()(const char *lhs, const char *rhs) const NOEXCEPT {
 				return std::strcmp(lhs, rhs) < 0;
@@ -46,6 +55,108 @@ namespace MySql {
 #define DEBUG_THROW_MYSQL_EXCEPTION(mysql_, schema_)	\
 		DEBUG_THROW(::Poseidon::MySql::Exception, schema_, ::mysql_errno(mysql_), ::Poseidon::SharedNts(::mysql_error(mysql_)))
 
+#define DEBUG_THROW_MYSQL_STMT_EXCEPTION(stmt_, schema_)	\
+		DEBUG_THROW(::Poseidon::MySql::Exception, schema_, ::mysql_stmt_errno(stmt_), ::Poseidon::SharedNts(::mysql_stmt_error(stmt_)))
+
+		// 每个连接缓存的预处理语句数量上限，超过后释放最久没有使用的一个。
+		const std::size_t MAX_CACHED_STATEMENTS = 256;
+		// 结果集中不存在的列的下标。
+		const std::size_t NO_SUCH_FIELD = static_cast<std::size_t>(-1);
+
+		// MySQL 8 删除了 my_bool，改用 bool。从 MYSQL_BIND::is_null 的类型推导，两者都能编译。
+		template<typename MemberPtrT>
+		struct MemberPointee;
+		template<typename ClassT, typename T>
+		struct MemberPointee<T *ClassT::*> {
+			typedef T type;
+		};
+		typedef MemberPointee<CV_VALUE_TYPE(&::MYSQL_BIND::is_null)>::type MySqlBool;
+
+		// 二进制结果集中的一列。整数、浮点数和日期时间按原样取回，其余按字符串取回。
+		struct BinaryColumn {
+			::enum_field_types type;
+			bool is_unsigned;
+			boost::uint64_t integer;
+			double real;
+			::MYSQL_TIME time;
+			std::vector<char> buffer;
+			unsigned long length;
+			MySqlBool is_null;
+			MySqlBool error;
+		};
+
+		boost::int64_t parse_signed(const char *data){
+			char *endptr;
+			const AUTO(val, ::strtoll(data, &endptr, 10));
+			if(*endptr){
+				LOG_POSEIDON_ERROR("Could not convert field data to long long: ", data);
+				DEBUG_THROW(BasicException, sslit("Could not convert field data to long long"));
+			}
+			return val;
+		}
+		boost::uint64_t parse_unsigned(const char *data){
+			char *endptr;
+			const AUTO(val, ::strtoull(data, &endptr, 10));
+			if(*endptr){
+				LOG_POSEIDON_ERROR("Could not convert field data to unsigned long long: ", data);
+				DEBUG_THROW(BasicException, sslit("Could not convert field data to unsigned long long"));
+			}
+			return val;
+		}
+		double parse_double(const char *data){
+			char *endptr;
+			const AUTO(val, ::strtod(data, &endptr));
+			if(*endptr){
+				LOG_POSEIDON_ERROR("Could not convert field data to double: ", data);
+				DEBUG_THROW(BasicException, sslit("Could not convert field data to double"));
+			}
+			return val;
+		}
+		Uuid parse_uuid(const char *data, std::size_t size){
+			if(size != 36){
+				LOG_POSEIDON_ERROR("Invalid UUID string: ", data);
+				DEBUG_THROW(BasicException, sslit("Invalid UUID string"));
+			}
+			return Uuid(reinterpret_cast<const char (&)[36]>(data[0]));
+		}
+
+		// 与 format_time() 和 scan_time() 相同，0 对应 0000 年，-1 对应 9999 年。
+		void time_to_mysql(::MYSQL_TIME &time, boost::uint64_t ms){
+			DateTime dt = { 1234, 1, 1, 0, 0, 0, 0 };
+			if(ms == 0){
+				dt.yr = 0;
+			} else if(ms == (boost::uint64_t)-1){
+				dt.yr = 9999;
+			} else {
+				dt = break_down_time(ms);
+			}
+			std::memset(&time, 0, sizeof(time));
+			time.year = dt.yr;
+			time.month = dt.mon;
+			time.day = dt.day;
+			time.hour = dt.hr;
+			time.minute = dt.min;
+			time.second = dt.sec;
+			time.second_part = dt.ms * 1000ul;
+			time.time_type = MYSQL_TIMESTAMP_DATETIME;
+		}
+		boost::uint64_t time_from_mysql(const ::MYSQL_TIME &time){
+			if(time.year == 0){
+				return 0;
+			} else if(time.year == 9999){
+				return (boost::uint64_t)-1;
+			}
+			DateTime dt;
+			dt.yr = time.year;
+			dt.mon = time.month;
+			dt.day = time.day;
+			dt.hr = time.hour;
+			dt.min = time.minute;
+			dt.sec = time.second;
+			dt.ms = static_cast<unsigned>(time.second_part / 1000);
+			return assemble_time(dt);
+		}
+
 		class DelegatedConnection : public Connection {
 		private:
 			const ThreadContext m_context;
@@ -59,11 +170,31 @@ namespace MySql {
 			::MYSQL_ROW m_row;
 			unsigned long *m_lengths;
 
+			// 最近一次 get_field_indices() 的结果，结果集改变时清空。
+			mutable const char *const *m_index_names;
+			mutable std::vector<std::size_t> m_indices;
+
+			struct CachedStatement {
+				::MYSQL_STMT *stmt;
+				boost::uint64_t last_use;
+			};
+			boost::container::flat_map<std::string, CachedStatement> m_statements;
+			boost::uint64_t m_statement_clock; // 每次使用缓存的语句时递增。
+			::MYSQL_STMT *m_stmt; // 当前结果集所属的预处理语句。
+			UniqueHandle<ResultDeleter> m_stmt_metadata;
+			std::vector<BinaryColumn> m_columns;
+			std::vector< ::MYSQL_BIND> m_column_binds;
+			bool m_stmt_row;
+			boost::uint64_t m_affected_rows;
+
 		public:
 			DelegatedConnection(const char *server_addr, unsigned server_port,
 				const char *user_name, const char *password, const char *schema, bool use_ssl, const char *charset)
 				: m_schema(schema)
 				, m_row(NULLPTR), m_lengths(NULLPTR)
+				, m_index_names(NULLPTR)
+				, m_statement_clock(0)
+				, m_stmt(NULLPTR), m_stmt_row(false), m_affected_rows(0)
 			{
 				if(!m_mysql.reset(::mysql_init(&m_mysql_storage))){
 					DEBUG_THROW(SystemException, ENOMEM);
@@ -72,7 +203,7 @@ namespace MySql {
 				if(::mysql_options(m_mysql.get(), MYSQL_OPT_COMPRESS, NULLPTR) != 0){
 					DEBUG_THROW_MYSQL_EXCEPTION(m_mysql.get(), m_schema);
 				}
-				static CONSTEXPR const ::my_bool TRUE_VALUE = true;
+				static CONSTEXPR const MySqlBool TRUE_VALUE = true;
 				if(::mysql_options(m_mysql.get(), MYSQL_OPT_RECONNECT, &TRUE_VALUE) != 0){
 					DEBUG_THROW_MYSQL_EXCEPTION(m_mysql.get(), m_schema);
 				}
@@ -80,7 +211,7 @@ namespace MySql {
 					DEBUG_THROW_MYSQL_EXCEPTION(m_mysql.get(), m_schema);
 				}
 
-				unsigned long flags = 0;
+				unsigned long flags = CLIENT_FOUND_ROWS;
 				if(use_ssl){
 					flags |= CLIENT_SSL;
 				}
@@ -89,23 +220,112 @@ namespace MySql {
 				}
 			}
 
+			~DelegatedConnection(){
+				do_discard_result();
+				close_all_statements();
+			}
+
 		private:
-			bool find_field_and_check(const char *&data, std::size_t &size, const char *name) const {
+			void close_all_statements() NOEXCEPT {
+				for(AUTO(it, m_statements.begin()); it != m_statements.end(); ++it){
+					::mysql_stmt_close(it->second.stmt);
+				}
+				m_statements.clear();
+			}
+			void close_statement(const char *sql) NOEXCEPT {
+				const AUTO(it, m_statements.find(std::string(sql)));
+				if(it == m_statements.end()){
+					return;
+				}
+				::mysql_stmt_close(it->second.stmt);
+				m_statements.erase(it);
+			}
+			void close_least_recently_used_statement() NOEXCEPT {
+				AUTO(victim, m_statements.begin());
+				for(AUTO(it, m_statements.begin()); it != m_statements.end(); ++it){
+					if(it->second.last_use < victim->second.last_use){
+						victim = it;
+					}
+				}
+				if(victim == m_statements.end()){
+					return;
+				}
+				LOG_POSEIDON_DEBUG("Releasing least recently used prepared statement: sql = ", victim->first);
+				::mysql_stmt_close(victim->second.stmt);
+				m_statements.erase(victim);
+			}
+			::MYSQL_STMT *require_statement(const char *sql){
+				const std::string key(sql);
+				const AUTO(it, m_statements.find(key));
+				if(it != m_statements.end()){
+					it->second.last_use = ++m_statement_clock;
+					return it->second.stmt;
+				}
+				if(m_statements.size() >= MAX_CACHED_STATEMENTS){
+					close_least_recently_used_statement();
+				}
+				UniqueHandle<StatementCloser> stmt;
+				if(!stmt.reset(::mysql_stmt_init(m_mysql.get()))){
+					DEBUG_THROW(SystemException, ENOMEM);
+				}
+				if(::mysql_stmt_prepare(stmt.get(), key.data(), key.size()) != 0){
+					DEBUG_THROW_MYSQL_STMT_EXCEPTION(stmt.get(), m_schema);
+				}
+				LOG_POSEIDON_DEBUG("Prepared MySQL statement: sql = ", key);
+				CachedStatement cached;
+				cached.stmt = stmt.get();
+				cached.last_use = ++m_statement_clock;
+				m_statements.insert(std::make_pair(key, cached));
+				return stmt.release();
+			}
+
+			const BinaryColumn *find_column_and_check(std::size_t index) const {
+				if(!m_stmt_row){
+					LOG_POSEIDON_WARNING("No more results available.");
+					return NULLPTR;
+				}
+				if(index >= m_columns.size()){
+					// 找不到列的警告在查找下标时已经输出过了。
+					return NULLPTR;
+				}
+				const AUTO_REF(column, m_columns[index]);
+				if(column.is_null){
+					LOG_POSEIDON_DEBUG("Field is null: index = ", index);
+					return NULLPTR;
+				}
+				return &column;
+			}
+			std::string get_binary_string(const BinaryColumn &column) const {
+				char temp[256];
+				switch(column.type){
+				case MYSQL_TYPE_LONGLONG:
+					if(column.is_unsigned){
+						return boost::lexical_cast<std::string>(column.integer);
+					}
+					return boost::lexical_cast<std::string>(static_cast<boost::int64_t>(column.integer));
+				case MYSQL_TYPE_DOUBLE:
+					return boost::lexical_cast<std::string>(column.real);
+				case MYSQL_TYPE_DATETIME:
+					return std::string(temp, format_time(temp, sizeof(temp), time_from_mysql(column.time), true));
+				default:
+					return std::string(&column.buffer[0], column.length);
+				}
+			}
+
+			bool find_field_and_check(const char *&data, std::size_t &size, std::size_t index) const {
 				if(!m_row){
 					LOG_POSEIDON_WARNING("No more results available.");
 					return false;
 				}
-				const AUTO(it, m_fields.find(name));
-				if(it == m_fields.end()){
-					LOG_POSEIDON_WARNING("Field not found: name = ", name);
+				if(index >= m_fields.size()){
 					return false;
 				}
-				data = m_row[it->second];
+				data = m_row[index];
 				if(!data){
-					LOG_POSEIDON_DEBUG("Field is null: name = ", name);
+					LOG_POSEIDON_DEBUG("Field is null: index = ", index);
 					return false;
 				}
-				size = m_lengths[it->second];
+				size = m_lengths[index];
 				return true;
 			}
 
@@ -116,6 +336,7 @@ namespace MySql {
 				if(::mysql_real_query(m_mysql.get(), sql, len) != 0){
 					DEBUG_THROW_MYSQL_EXCEPTION(m_mysql.get(), m_schema);
 				}
+				m_affected_rows = ::mysql_affected_rows(m_mysql.get());
 
 				if(!m_result.reset(::mysql_use_result(m_mysql.get()))){
 					if(::mysql_errno(m_mysql.get()) != 0){
@@ -136,16 +357,148 @@ namespace MySql {
 					}
 				}
 			}
+			void do_execute_prepared(const char *sql, const StatementParams &params){
+				do_discard_result();
+
+				const AUTO(stmt, require_statement(sql));
+				const std::size_t count = params.size();
+				if(::mysql_stmt_param_count(stmt) != count){
+					LOG_POSEIDON_ERROR("Prepared statement parameter count mismatch: expecting ", ::mysql_stmt_param_count(stmt), ", got ", count);
+					DEBUG_THROW(BasicException, sslit("Prepared statement parameter count mismatch"));
+				}
+				std::vector< ::MYSQL_BIND> binds(count);
+				std::vector< ::MYSQL_TIME> times(count);
+				for(std::size_t i = 0; i < count; ++i){
+					const AUTO_REF(elem, params.at(i));
+					AUTO_REF(bind, binds.at(i));
+					std::memset(&bind, 0, sizeof(bind));
+					switch(elem.type){
+					case StatementParams::T_SIGNED:
+					case StatementParams::T_UNSIGNED:
+						bind.buffer_type = MYSQL_TYPE_LONGLONG;
+						bind.buffer = const_cast<boost::uint64_t *>(&elem.integer);
+						bind.is_unsigned = (elem.type == StatementParams::T_UNSIGNED);
+						break;
+					case StatementParams::T_DOUBLE:
+						bind.buffer_type = MYSQL_TYPE_DOUBLE;
+						bind.buffer = const_cast<double *>(&elem.real);
+						break;
+					case StatementParams::T_STRING:
+						bind.buffer_type = MYSQL_TYPE_STRING;
+						bind.buffer = const_cast<char *>(elem.str.data());
+						bind.buffer_length = elem.str.size();
+						break;
+					case StatementParams::T_DATETIME:
+						time_to_mysql(times.at(i), elem.integer);
+						bind.buffer_type = MYSQL_TYPE_DATETIME;
+						bind.buffer = &times.at(i);
+						break;
+					default:
+						LOG_POSEIDON_ERROR("Unknown parameter type: ", static_cast<int>(elem.type));
+						DEBUG_THROW(BasicException, sslit("Unknown parameter type"));
+					}
+				}
+				if((count != 0) && (::mysql_stmt_bind_param(stmt, &binds[0]) != 0)){
+					DEBUG_THROW_MYSQL_STMT_EXCEPTION(stmt, m_schema);
+				}
+				if(::mysql_stmt_execute(stmt) != 0){
+					// 重新连接之后语句句柄就失效了，下次重新预处理。
+					const AUTO(err_code, ::mysql_stmt_errno(stmt));
+					const std::string err_msg(::mysql_stmt_error(stmt));
+					close_statement(sql);
+					DEBUG_THROW(Exception, m_schema, err_code, SharedNts(err_msg));
+				}
+				m_affected_rows = ::mysql_stmt_affected_rows(stmt);
+
+				if(!m_stmt_metadata.reset(::mysql_stmt_result_metadata(stmt))){
+					if(::mysql_stmt_errno(stmt) != 0){
+						DEBUG_THROW_MYSQL_STMT_EXCEPTION(stmt, m_schema);
+					}
+					// 没有返回结果。
+					return;
+				}
+				m_stmt = stmt;
+
+				const AUTO(fields, ::mysql_fetch_fields(m_stmt_metadata.get()));
+				const AUTO(field_count, ::mysql_num_fields(m_stmt_metadata.get()));
+				m_columns.resize(field_count);
+				m_column_binds.resize(field_count);
+				m_fields.reserve(field_count);
+				for(std::size_t i = 0; i < field_count; ++i){
+					AUTO_REF(column, m_columns.at(i));
+					AUTO_REF(bind, m_column_binds.at(i));
+					std::memset(&bind, 0, sizeof(bind));
+					column.is_unsigned = false;
+					switch(fields[i].type){
+					case MYSQL_TYPE_TINY:
+					case MYSQL_TYPE_SHORT:
+					case MYSQL_TYPE_INT24:
+					case MYSQL_TYPE_LONG:
+					case MYSQL_TYPE_LONGLONG:
+					case MYSQL_TYPE_YEAR:
+						column.type = MYSQL_TYPE_LONGLONG;
+						bind.buffer = &column.integer;
+						column.is_unsigned = (fields[i].flags & UNSIGNED_FLAG) != 0;
+						bind.is_unsigned = column.is_unsigned;
+						break;
+					case MYSQL_TYPE_FLOAT:
+					case MYSQL_TYPE_DOUBLE:
+						column.type = MYSQL_TYPE_DOUBLE;
+						bind.buffer = &column.real;
+						break;
+					case MYSQL_TYPE_DATE:
+					case MYSQL_TYPE_DATETIME:
+					case MYSQL_TYPE_TIMESTAMP:
+						column.type = MYSQL_TYPE_DATETIME;
+						bind.buffer = &column.time;
+						break;
+					default:
+						column.type = MYSQL_TYPE_STRING;
+						column.buffer.resize(256);
+						bind.buffer = &column.buffer[0];
+						bind.buffer_length = column.buffer.size();
+						break;
+					}
+					bind.buffer_type = column.type;
+					bind.length = &column.length;
+					bind.is_null = &column.is_null;
+					bind.error = &column.error;
+
+					const char *const name = fields[i].name;
+					if(!m_fields.insert(std::make_pair(name, i)).second){
+						LOG_POSEIDON_ERROR("Duplicate field in MySQL result set: ", name);
+						DEBUG_THROW(BasicException, sslit("Duplicate field"));
+					}
+					LOG_POSEIDON_TRACE("MySQL binary result field: name = ", name, ", index = ", i);
+				}
+				if(::mysql_stmt_bind_result(m_stmt, &m_column_binds[0]) != 0){
+					DEBUG_THROW_MYSQL_STMT_EXCEPTION(m_stmt, m_schema);
+				}
+			}
 			void do_discard_result() NOEXCEPT {
 				m_result.reset();
 				m_fields.clear();
 				m_row = NULLPTR;
 				m_lengths = NULLPTR;
+				m_index_names = NULLPTR;
+				m_indices.clear();
+
+				if(m_stmt){
+					::mysql_stmt_free_result(m_stmt);
+					m_stmt = NULLPTR;
+				}
+				m_stmt_metadata.reset();
+				m_columns.clear();
+				m_column_binds.clear();
+				m_stmt_row = false;
 			}
 
 			boost::uint64_t do_get_insert_id() const {
 				return ::mysql_insert_id(m_mysql.get());
 			}
+			boost::uint64_t do_get_affected_rows() const {
+				return m_affected_rows;
+			}
 
 			bool do_fetch_row(){
 				if(m_fields.empty()){
@@ -153,6 +506,39 @@ namespace MySql {
 					return false;
 				}
 
+				if(m_stmt){
+					m_stmt_row = false;
+					const int result = ::mysql_stmt_fetch(m_stmt);
+					if(result == MYSQL_NO_DATA){
+						LOG_POSEIDON_DEBUG("No more data.");
+						return false;
+					}
+					if(result == 1){
+						DEBUG_THROW_MYSQL_STMT_EXCEPTION(m_stmt, m_schema);
+					}
+					if(result == MYSQL_DATA_TRUNCATED){
+						// 字符串比缓冲区长，扩大缓冲区之后单独取回这一列。
+						for(std::size_t i = 0; i < m_columns.size(); ++i){
+							AUTO_REF(column, m_columns.at(i));
+							if((column.type != MYSQL_TYPE_STRING) || column.is_null || (column.length <= column.buffer.size())){
+								continue;
+							}
+							AUTO_REF(bind, m_column_binds.at(i));
+							column.buffer.resize(column.length);
+							bind.buffer = &column.buffer[0];
+							bind.buffer_length = column.buffer.size();
+							if(::mysql_stmt_fetch_column(m_stmt, &bind, static_cast<unsigned>(i), 0) != 0){
+								DEBUG_THROW_MYSQL_STMT_EXCEPTION(m_stmt, m_schema);
+							}
+						}
+						if(::mysql_stmt_bind_result(m_stmt, &m_column_binds[0]) != 0){
+							DEBUG_THROW_MYSQL_STMT_EXCEPTION(m_stmt, m_schema);
+						}
+					}
+					m_stmt_row = true;
+					return true;
+				}
+
 				const AUTO(row, ::mysql_fetch_row(m_result.get()));
 				if(!row){
 					LOG_POSEIDON_DEBUG("No more data.");
@@ -164,79 +550,149 @@ namespace MySql {
 				return true;
 			}
 
-			boost::int64_t do_get_signed(const char *name) const {
+			std::size_t do_find_field(const char *name) const {
+				const AUTO(it, m_fields.find(name));
+				if(it == m_fields.end()){
+					LOG_POSEIDON_WARNING("Field not found: name = ", name);
+					return NO_SUCH_FIELD;
+				}
+				return it->second;
+			}
+			const std::size_t *do_get_field_indices(const char *const *names, std::size_t count) const {
+				if((m_index_names != names) || (m_indices.size() != count)){
+					m_indices.resize(count);
+					for(std::size_t i = 0; i < count; ++i){
+						m_indices[i] = do_find_field(names[i]);
+					}
+					m_index_names = names;
+				}
+				if(m_indices.empty()){
+					return NULLPTR;
+				}
+				return &m_indices[0];
+			}
+
+			boost::int64_t do_get_signed(std::size_t index) const {
+				if(m_stmt){
+					const AUTO(column, find_column_and_check(index));
+					if(!column){
+						return VAL_INIT;
+					}
+					if(column->type == MYSQL_TYPE_LONGLONG){
+						return static_cast<boost::int64_t>(column->integer);
+					}
+					if(column->type == MYSQL_TYPE_DOUBLE){
+						return static_cast<boost::int64_t>(column->real);
+					}
+					return parse_signed(get_binary_string(*column).c_str());
+				}
 				const char *data;
 				std::size_t size;
-				if(!find_field_and_check(data, size, name)){
+				if(!find_field_and_check(data, size, index)){
 					return VAL_INIT;
 				}
-				char *endptr;
-				const AUTO(val, ::strtoll(data, &endptr, 10));
-				if(*endptr){
-					LOG_POSEIDON_ERROR("Could not convert field data to long long: ", data);
-					DEBUG_THROW(BasicException, sslit("Could not convert field data to long long"));
-				}
-				return val;
+				return parse_signed(data);
 			}
-			boost::uint64_t do_get_unsigned(const char *name) const {
+			boost::uint64_t do_get_unsigned(std::size_t index) const {
+				if(m_stmt){
+					const AUTO(column, find_column_and_check(index));
+					if(!column){
+						return VAL_INIT;
+					}
+					if(column->type == MYSQL_TYPE_LONGLONG){
+						return column->integer;
+					}
+					if(column->type == MYSQL_TYPE_DOUBLE){
+						return static_cast<boost::uint64_t>(column->real);
+					}
+					return parse_unsigned(get_binary_string(*column).c_str());
+				}
 				const char *data;
 				std::size_t size;
-				if(!find_field_and_check(data, size, name)){
+				if(!find_field_and_check(data, size, index)){
 					return VAL_INIT;
 				}
-				char *endptr;
-				const AUTO(val, ::strtoull(data, &endptr, 10));
-				if(*endptr){
-					LOG_POSEIDON_ERROR("Could not convert field data to unsigned long long: ", data);
-					DEBUG_THROW(BasicException, sslit("Could not convert field data to unsigned long long"));
-				}
-				return val;
+				return parse_unsigned(data);
 			}
-			double do_get_double(const char *name) const {
+			double do_get_double(std::size_t index) const {
+				if(m_stmt){
+					const AUTO(column, find_column_and_check(index));
+					if(!column){
+						return VAL_INIT;
+					}
+					if(column->type == MYSQL_TYPE_DOUBLE){
+						return column->real;
+					}
+					if(column->type == MYSQL_TYPE_LONGLONG){
+						return static_cast<double>(static_cast<boost::int64_t>(column->integer));
+					}
+					return parse_double(get_binary_string(*column).c_str());
+				}
 				const char *data;
 				std::size_t size;
-				if(!find_field_and_check(data, size, name)){
+				if(!find_field_and_check(data, size, index)){
 					return VAL_INIT;
 				}
-				char *endptr;
-				const AUTO(val, ::strtod(data, &endptr));
-				if(*endptr){
-					LOG_POSEIDON_ERROR("Could not convert field data to double: ", data);
-					DEBUG_THROW(BasicException, sslit("Could not convert field data to double"));
-				}
-				return val;
+				return parse_double(data);
 			}
-			std::string do_get_string(const char *name) const {
+			std::string do_get_string(std::size_t index) const {
+				if(m_stmt){
+					const AUTO(column, find_column_and_check(index));
+					if(!column){
+						return VAL_INIT;
+					}
+					return get_binary_string(*column);
+				}
 				const char *data;
 				std::size_t size;
-				if(!find_field_and_check(data, size, name)){
+				if(!find_field_and_check(data, size, index)){
 					return VAL_INIT;
 				}
 				return std::string(data, size);
 			}
-			boost::uint64_t do_get_datetime(const char *name) const {
+			boost::uint64_t do_get_datetime(std::size_t index) const {
+				if(m_stmt){
+					const AUTO(column, find_column_and_check(index));
+					if(!column){
+						return VAL_INIT;
+					}
+					if(column->type == MYSQL_TYPE_DATETIME){
+						return time_from_mysql(column->time);
+					}
+					return scan_time(get_binary_string(*column).c_str());
+				}
 				const char *data;
 				std::size_t size;
-				if(!find_field_and_check(data, size, name)){
+				if(!find_field_and_check(data, size, index)){
 					return VAL_INIT;
 				}
 				return scan_time(data);
 			}
-			Uuid do_get_uuid(const char *name) const {
+			Uuid do_get_uuid(std::size_t index) const {
+				if(m_stmt){
+					const AUTO(column, find_column_and_check(index));
+					if(!column){
+						return VAL_INIT;
+					}
+					const AUTO(str, get_binary_string(*column));
+					return parse_uuid(str.c_str(), str.size());
+				}
 				const char *data;
 				std::size_t size;
-				if(!find_field_and_check(data, size, name)){
+				if(!find_field_and_check(data, size, index)){
 					return VAL_INIT;
 				}
-				if(size != 36){
-					LOG_POSEIDON_ERROR("Invalid UUID string: ", data);
-					DEBUG_THROW(BasicException, sslit("Invalid UUID string"));
-				}
-				return Uuid(reinterpret_cast<const char (&)[36]>(data[0]));
+				return parse_uuid(data, size);
 			}
 		};
 	}
 
+	void StatementParams::add_uuid(const Uuid &val){
+		std::string str;
+		val.to_string(str);
+		add_string(STD_MOVE(str));
+	}
+
 	boost::shared_ptr<Connection> Connection::create(const char *server_addr, unsigned server_port,
 		const char *user_name, const char *password, const char *schema, bool use_ssl, const char *charset)
 	{
@@ -250,6 +706,9 @@ namespace MySql {
 	void Connection::execute_sql(const char *sql, std::size_t len){
 		static_cast<DelegatedConnection &>(*this).do_execute_sql(sql, len);
 	}
+	void Connection::execute_prepared(const char *sql, const StatementParams &params){
+		static_cast<DelegatedConnection &>(*this).do_execute_prepared(sql, params);
+	}
 	void Connection::discard_result() NOEXCEPT {
 		static_cast<DelegatedConnection &>(*this).do_discard_result();
 	}
@@ -257,27 +716,59 @@ namespace MySql {
 	boost::uint64_t Connection::get_insert_id() const {
 		return static_cast<const DelegatedConnection &>(*this).do_get_insert_id();
 	}
+	boost::uint64_t Connection::get_affected_rows() const {
+		return static_cast<const DelegatedConnection &>(*this).do_get_affected_rows();
+	}
 	bool Connection::fetch_row(){
 		return static_cast<DelegatedConnection &>(*this).do_fetch_row();
 	}
 
+	const std::size_t *Connection::get_field_indices(const char *const *names, std::size_t count) const {
+		return static_cast<const DelegatedConnection &>(*this).do_get_field_indices(names, count);
+	}
+
 	boost::int64_t Connection::get_signed(const char *name) const {
-		return static_cast<const DelegatedConnection &>(*this).do_get_signed(name);
+		const AUTO_REF(conn, static_cast<const DelegatedConnection &>(*this));
+		return conn.do_get_signed(conn.do_find_field(name));
 	}
 	boost::uint64_t Connection::get_unsigned(const char *name) const {
-		return static_cast<const DelegatedConnection &>(*this).do_get_unsigned(name);
+		const AUTO_REF(conn, static_cast<const DelegatedConnection &>(*this));
+		return conn.do_get_unsigned(conn.do_find_field(name));
 	}
 	double Connection::get_double(const char *name) const {
-		return static_cast<const DelegatedConnection &>(*this).do_get_double(name);
+		const AUTO_REF(conn, static_cast<const DelegatedConnection &>(*this));
+		return conn.do_get_double(conn.do_find_field(name));
 	}
 	std::string Connection::get_string(const char *name) const {
-		return static_cast<const DelegatedConnection &>(*this).do_get_string(name);
+		const AUTO_REF(conn, static_cast<const DelegatedConnection &>(*this));
+		return conn.do_get_string(conn.do_find_field(name));
 	}
 	boost::uint64_t Connection::get_datetime(const char *name) const {
-		return static_cast<const DelegatedConnection &>(*this).do_get_datetime(name);
+		const AUTO_REF(conn, static_cast<const DelegatedConnection &>(*this));
+		return conn.do_get_datetime(conn.do_find_field(name));
 	}
 	Uuid Connection::get_uuid(const char *name) const {
-		return static_cast<const DelegatedConnection &>(*this).do_get_uuid(name);
+		const AUTO_REF(conn, static_cast<const DelegatedConnection &>(*this));
+		return conn.do_get_uuid(conn.do_find_field(name));
+	}
+
+	boost::int64_t Connection::get_signed(std::size_t index) const {
+		return static_cast<const DelegatedConnection &>(*this).do_get_signed(index);
+	}
+	boost::uint64_t Connection::get_unsigned(std::size_t index) const {
+		return static_cast<const DelegatedConnection &>(*this).do_get_unsigned(index);
+	}
+	double Connection::get_double(std::size_t index) const {
+		return static_cast<const DelegatedConnection &>(*this).do_get_double(index);
+	}
+	std::string Connection::get_string(std::size_t index) const {
+		return static_cast<const DelegatedConnection &>(*this).do_get_string(index);
+	}
+	boost::uint64_t Connection::get_datetime(std::size_t index) const {
+		return static_cast<const DelegatedConnection &>(*this).do_get_datetime(index);
+	}
+	Uuid Connection::get_uuid(std::size_t index) const {
+		return static_cast<const DelegatedConnection &>(*this).do_get_uuid(index);
 	}
 }
 
@@ -7,6 +7,7 @@
 #include "../cxx_ver.hpp"
 #include "../cxx_util.hpp"
 #include <string>
+#include <vector>
 #include <cstring>
 #include <boost/cstdint.hpp>
 #include <boost/shared_ptr.hpp>
@@ -16,6 +17,74 @@ namespace Poseidon {
 class Uuid;
 
 namespace MySql {
+	// 预处理语句的参数，按照占位符的顺序添加。以二进制形式发送，无需转义。
+	class StatementParams {
+	public:
+		enum Type {
+			T_SIGNED,
+			T_UNSIGNED,
+			T_DOUBLE,
+			T_STRING,
+			T_DATETIME,
+		};
+
+		struct Element {
+			Type type;
+			boost::uint64_t integer;
+			double real;
+			std::string str;
+		};
+
+	private:
+		std::vector<Element> m_elements;
+
+	public:
+		explicit StatementParams(std::size_t reserved = 0){
+			m_elements.reserve(reserved);
+		}
+
+	private:
+		Element &push(Type type){
+			m_elements.push_back(Element());
+			Element &elem = m_elements.back();
+			elem.type = type;
+			elem.integer = 0;
+			elem.real = 0;
+			return elem;
+		}
+
+	public:
+		bool empty() const {
+			return m_elements.empty();
+		}
+		std::size_t size() const {
+			return m_elements.size();
+		}
+		const Element &at(std::size_t index) const {
+			return m_elements.at(index);
+		}
+		void clear(){
+			m_elements.clear();
+		}
+
+		void add_signed(boost::int64_t val){
+			push(T_SIGNED).integer = static_cast<boost::uint64_t>(val);
+		}
+		void add_unsigned(boost::uint64_t val){
+			push(T_UNSIGNED).integer = val;
+		}
+		void add_double(double val){
+			push(T_DOUBLE).real = val;
+		}
+		void add_string(std::string val){
+			push(T_STRING).str.swap(val);
+		}
+		void add_datetime(boost::uint64_t val){
+			push(T_DATETIME).integer = val;
+		}
+		void add_uuid(const Uuid &val);
+	};
+
 	class Connection : NONCOPYABLE {
 	public:
 		static boost::shared_ptr<Connection> create(const char *server_addr, unsigned server_port,
@@ -39,9 +108,17 @@ namespace MySql {
 		void execute_sql(const std::string &sql){
 			execute_sql(sql.data(), sql.size());
 		}
+		// 服务端预处理语句。每个连接按 SQL 文本缓存语句句柄，结果集以二进制形式取回。
+		// 取回结果的方式与 execute_sql() 相同。
+		void execute_prepared(const char *sql, const StatementParams &params);
+		void execute_prepared(const std::string &sql, const StatementParams &params){
+			execute_prepared(sql.c_str(), params);
+		}
 		void discard_result() NOEXCEPT;
 
 		boost::uint64_t get_insert_id() const;
+		// 对于 UPDATE 返回匹配的行数，而不是实际修改的行数。
+		boost::uint64_t get_affected_rows() const;
 		bool fetch_row();
 
 		boost::int64_t get_signed(const char *name) const;
@@ -50,6 +127,16 @@ namespace MySql {
 		std::string get_string(const char *name) const;
 		boost::uint64_t get_datetime(const char *name) const;
 		Uuid get_uuid(const char *name) const;
+
+		// 按名字查找列在当前结果集中的下标，不存在的列为 -1。
+		// 结果按 names 的地址缓存到结果集改变为止，因此 names 应当是静态数组。
+		const std::size_t *get_field_indices(const char *const *names, std::size_t count) const;
+		boost::int64_t get_signed(std::size_t index) const;
+		boost::uint64_t get_unsigned(std::size_t index) const;
+		double get_double(std::size_t index) const;
+		std::string get_string(std::size_t index) const;
+		boost::uint64_t get_datetime(std::size_t index) const;
+		Uuid get_uuid(std::size_t index) const;
 	};
 }
 
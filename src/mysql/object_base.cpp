@@ -44,6 +44,35 @@ namespace MySql {
 	void ObjectBase::set_combined_write_stamp(void *stamp) const {
 		atomic_store(m_combined_write_stamp, stamp, ATOMIC_RELEASE);
 	}
+	boost::uint64_t ObjectBase::next_save_serial() const {
+		const RecursiveMutex::UniqueLock lock(m_mutex);
+		return ++m_save_serial;
+	}
+	bool ObjectBase::take_dirty_fields(std::vector<bool> &dirty_fields, boost::uint64_t serial, bool *covered) const {
+		const RecursiveMutex::UniqueLock lock(m_mutex);
+		if(covered){
+			*covered = (serial != 0) && (serial <= m_taken_serial);
+		}
+		dirty_fields = m_dirty_fields;
+		const bool any = std::find(m_dirty_fields.begin(), m_dirty_fields.end(), true) != m_dirty_fields.end();
+		std::fill(m_dirty_fields.begin(), m_dirty_fields.end(), false);
+		// 在这之前创建的写入操作所对应的修改都已经取出了，由取出的这次写入负责。
+		m_taken_serial = m_save_serial;
+		return any;
+	}
+	void ObjectBase::restore_dirty_fields(const std::vector<bool> &dirty_fields) const {
+		const RecursiveMutex::UniqueLock lock(m_mutex);
+		if(std::find(dirty_fields.begin(), dirty_fields.end(), true) == dirty_fields.end()){
+			std::fill(m_dirty_fields.begin(), m_dirty_fields.end(), true);
+			return;
+		}
+		const std::size_t count = std::min(m_dirty_fields.size(), dirty_fields.size());
+		for(std::size_t index = 0; index < count; ++index){
+			if(dirty_fields.at(index)){
+				m_dirty_fields.at(index) = true;
+			}
+		}
+	}
 	void ObjectBase::async_save(bool to_replace, bool urgent) const {
 		enable_auto_saving();
 		MySqlDaemon::enqueue_for_saving(virtual_shared_from_this<ObjectBase>(), to_replace, urgent);
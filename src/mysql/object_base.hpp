@@ -41,9 +41,17 @@ namespace MySql {
 	protected:
 		mutable RecursiveMutex m_mutex;
 
+	private:
+		// 按字段声明的顺序记录自上次写入以来修改过的字段。受 m_mutex 保护。
+		mutable std::vector<bool> m_dirty_fields;
+		// 写入操作的序号，以及最近一次取出修改标记时最大的序号。受 m_mutex 保护。
+		mutable boost::uint64_t m_save_serial;
+		mutable boost::uint64_t m_taken_serial;
+
 	public:
 		ObjectBase()
 			: m_auto_saves(false), m_combined_write_stamp(NULLPTR)
+			, m_save_serial(0), m_taken_serial(0)
 		{
 		}
 		// 不要不写析构函数，否则 RTTI 将无法在动态库中使用。
@@ -59,9 +67,31 @@ namespace MySql {
 		void *get_combined_write_stamp() const;
 		void set_combined_write_stamp(void *stamp) const;
 
+		std::size_t get_field_count() const {
+			return m_dirty_fields.size();
+		}
+		// 每个写入操作创建时取得一个序号。
+		boost::uint64_t next_save_serial() const;
+		// 取出并清除修改标记。返回 false 表示没有记录到修改。
+		// 如果 covered 不为空，serial 在这之前已经被取出过修改标记的写入覆盖时，*covered 为 true。
+		bool take_dirty_fields(std::vector<bool> &dirty_fields, boost::uint64_t serial = 0, bool *covered = NULLPTR) const;
+		// 写入失败时，把取出的修改标记合并回去，以免下次写入时遗漏这些字段。
+		// 没有任何标记时标记所有字段，使得下次写入整行。
+		void restore_dirty_fields(const std::vector<bool> &dirty_fields) const;
+
 		virtual const char *get_table() const = 0;
 
 		virtual void generate_sql(std::ostream &os) const = 0;
+		// 用于合并多行写入。前者输出逗号分隔的列名，后者按相同顺序输出逗号分隔的值。
+		virtual void generate_sql_columns(std::ostream &os) const = 0;
+		virtual void generate_sql_values(std::ostream &os) const = 0;
+		// 用于预处理语句。前者返回形如 "`a` = ?, `b` = ?" 的字符串，后者按相同顺序绑定字段的值。
+		virtual const char *get_sql_placeholders() const = 0;
+		virtual void bind_sql_params(StatementParams &params) const = 0;
+		// 用于只写入修改过的字段。index 是字段声明的顺序。
+		virtual const char *get_field_name(std::size_t index) const = 0;
+		virtual void generate_sql_field_value(std::ostream &os, std::size_t index) const = 0;
+		virtual void bind_sql_field_param(StatementParams &params, std::size_t index) const = 0;
 		virtual void fetch(const boost::shared_ptr<const Connection> &conn) = 0;
 		void async_save(bool to_replace, bool urgent = false) const;
 	};
@@ -70,12 +100,14 @@ namespace MySql {
 	class ObjectBase::Field : NONCOPYABLE {
 	private:
 		ObjectBase *const m_parent;
+		const std::size_t m_index;
 		ValueT m_value;
 
 	public:
 		explicit Field(ObjectBase *parent, ValueT value = ValueT())
-			: m_parent(parent), m_value(STD_MOVE_IDN(value))
+			: m_parent(parent), m_index(parent->m_dirty_fields.size()), m_value(STD_MOVE_IDN(value))
 		{
+			m_parent->m_dirty_fields.push_back(false);
 		}
 
 	public:
@@ -91,6 +123,7 @@ namespace MySql {
 			m_value = STD_MOVE_IDN(value);
 
 			if(invalidates_parent){
+				m_parent->m_dirty_fields.at(m_index) = true;
 				m_parent->invalidate();
 			}
 		}
@@ -104,6 +137,7 @@ namespace MySql {
 			is >>m_value;
 
 			if(invalidates_parent){
+				m_parent->m_dirty_fields.at(m_index) = true;
 				m_parent->invalidate();
 			}
 		}
@@ -149,7 +149,188 @@ public:
 
 		STRIP_FIRST(MYSQL_OBJECT_FIELDS) (void)0;
 	}
+	void generate_sql_columns(::std::ostream &os_) const OVERRIDE {
+
+#undef FIELD_BOOLEAN
+#undef FIELD_SIGNED
+#undef FIELD_UNSIGNED
+#undef FIELD_DOUBLE
+#undef FIELD_STRING
+#undef FIELD_DATETIME
+#undef FIELD_UUID
+#undef FIELD_BLOB
+
+#define FIELD_BOOLEAN(name_)                (void)(os_ <<", "),	\
+                                            (void)(os_ <<"`" TOKEN_TO_STR(name_) "`"),
+#define FIELD_SIGNED(name_)                 (void)(os_ <<", "),	\
+                                            (void)(os_ <<"`" TOKEN_TO_STR(name_) "`"),
+#define FIELD_UNSIGNED(name_)               (void)(os_ <<", "),	\
+                                            (void)(os_ <<"`" TOKEN_TO_STR(name_) "`"),
+#define FIELD_DOUBLE(name_)                 (void)(os_ <<", "),	\
+                                            (void)(os_ <<"`" TOKEN_TO_STR(name_) "`"),
+#define FIELD_STRING(name_)                 (void)(os_ <<", "),	\
+                                            (void)(os_ <<"`" TOKEN_TO_STR(name_) "`"),
+#define FIELD_DATETIME(name_)               (void)(os_ <<", "),	\
+                                            (void)(os_ <<"`" TOKEN_TO_STR(name_) "`"),
+#define FIELD_UUID(name_)                   (void)(os_ <<", "),	\
+                                            (void)(os_ <<"`" TOKEN_TO_STR(name_) "`"),
+#define FIELD_BLOB(name_)                   (void)(os_ <<", "),	\
+                                            (void)(os_ <<"`" TOKEN_TO_STR(name_) "`"),
+
+		STRIP_FIRST(MYSQL_OBJECT_FIELDS) (void)0;
+	}
+	void generate_sql_values(::std::ostream &os_) const OVERRIDE {
+
+#undef FIELD_BOOLEAN
+#undef FIELD_SIGNED
+#undef FIELD_UNSIGNED
+#undef FIELD_DOUBLE
+#undef FIELD_STRING
+#undef FIELD_DATETIME
+#undef FIELD_UUID
+#undef FIELD_BLOB
+
+#define FIELD_BOOLEAN(name_)                (void)(os_ <<", "),	\
+                                            (void)(os_ <<name_),
+#define FIELD_SIGNED(name_)                 (void)(os_ <<", "),	\
+                                            (void)(os_ <<name_),
+#define FIELD_UNSIGNED(name_)               (void)(os_ <<", "),	\
+                                            (void)(os_ <<name_),
+#define FIELD_DOUBLE(name_)                 (void)(os_ <<", "),	\
+                                            (void)(os_ <<name_),
+#define FIELD_STRING(name_)                 (void)(os_ <<", "),	\
+                                            (void)(os_ << ::Poseidon::MySql::StringEscaper(name_)),
+#define FIELD_DATETIME(name_)               (void)(os_ <<", "),	\
+                                            (void)(os_ << ::Poseidon::MySql::DateTimeFormatter(name_)),
+#define FIELD_UUID(name_)                   (void)(os_ <<", "),	\
+                                            (void)(os_ << ::Poseidon::MySql::UuidFormatter(name_)),
+#define FIELD_BLOB(name_)                   (void)(os_ <<", "),	\
+                                            (void)(os_ << ::Poseidon::MySql::StringEscaper(name_)),
+
+		STRIP_FIRST(MYSQL_OBJECT_FIELDS) (void)0;
+	}
+	const char *get_sql_placeholders() const OVERRIDE {
+
+#undef FIELD_BOOLEAN
+#undef FIELD_SIGNED
+#undef FIELD_UNSIGNED
+#undef FIELD_DOUBLE
+#undef FIELD_STRING
+#undef FIELD_DATETIME
+#undef FIELD_UUID
+#undef FIELD_BLOB
+
+#define FIELD_BOOLEAN(name_)                ", `" TOKEN_TO_STR(name_) "` = ?"
+#define FIELD_SIGNED(name_)                 ", `" TOKEN_TO_STR(name_) "` = ?"
+#define FIELD_UNSIGNED(name_)               ", `" TOKEN_TO_STR(name_) "` = ?"
+#define FIELD_DOUBLE(name_)                 ", `" TOKEN_TO_STR(name_) "` = ?"
+#define FIELD_STRING(name_)                 ", `" TOKEN_TO_STR(name_) "` = ?"
+#define FIELD_DATETIME(name_)               ", `" TOKEN_TO_STR(name_) "` = ?"
+#define FIELD_UUID(name_)                   ", `" TOKEN_TO_STR(name_) "` = ?"
+#define FIELD_BLOB(name_)                   ", `" TOKEN_TO_STR(name_) "` = ?"
+
+		return ("" MYSQL_OBJECT_FIELDS) + 2;
+	}
+	void bind_sql_params(::Poseidon::MySql::StatementParams &params_) const OVERRIDE {
+
+#undef FIELD_BOOLEAN
+#undef FIELD_SIGNED
+#undef FIELD_UNSIGNED
+#undef FIELD_DOUBLE
+#undef FIELD_STRING
+#undef FIELD_DATETIME
+#undef FIELD_UUID
+#undef FIELD_BLOB
+
+#define FIELD_BOOLEAN(name_)                params_.add_signed   (name_.get());
+#define FIELD_SIGNED(name_)                 params_.add_signed   (name_.get());
+#define FIELD_UNSIGNED(name_)               params_.add_unsigned (name_.get());
+#define FIELD_DOUBLE(name_)                 params_.add_double   (name_.get());
+#define FIELD_STRING(name_)                 params_.add_string   (name_.get());
+#define FIELD_DATETIME(name_)               params_.add_datetime (name_.get());
+#define FIELD_UUID(name_)                   params_.add_uuid     (name_.get());
+#define FIELD_BLOB(name_)                   params_.add_string   (name_.get());
+
+		MYSQL_OBJECT_FIELDS
+	}
+	static const char *const *get_field_names_(){
+
+#undef FIELD_BOOLEAN
+#undef FIELD_SIGNED
+#undef FIELD_UNSIGNED
+#undef FIELD_DOUBLE
+#undef FIELD_STRING
+#undef FIELD_DATETIME
+#undef FIELD_UUID
+#undef FIELD_BLOB
+
+#define FIELD_BOOLEAN(name_)                TOKEN_TO_STR(name_),
+#define FIELD_SIGNED(name_)                 TOKEN_TO_STR(name_),
+#define FIELD_UNSIGNED(name_)               TOKEN_TO_STR(name_),
+#define FIELD_DOUBLE(name_)                 TOKEN_TO_STR(name_),
+#define FIELD_STRING(name_)                 TOKEN_TO_STR(name_),
+#define FIELD_DATETIME(name_)               TOKEN_TO_STR(name_),
+#define FIELD_UUID(name_)                   TOKEN_TO_STR(name_),
+#define FIELD_BLOB(name_)                   TOKEN_TO_STR(name_),
+
+		static const char *const s_names_[] = { MYSQL_OBJECT_FIELDS };
+		return s_names_;
+	}
+	const char *get_field_name(::std::size_t index_) const OVERRIDE {
+		return get_field_names_()[index_];
+	}
+	void generate_sql_field_value(::std::ostream &os_, ::std::size_t index_) const OVERRIDE {
+		::std::size_t i_ = 0;
+
+#undef FIELD_BOOLEAN
+#undef FIELD_SIGNED
+#undef FIELD_UNSIGNED
+#undef FIELD_DOUBLE
+#undef FIELD_STRING
+#undef FIELD_DATETIME
+#undef FIELD_UUID
+#undef FIELD_BLOB
+
+#define FIELD_BOOLEAN(name_)                if(index_ == i_++){ os_ <<name_; return; }
+#define FIELD_SIGNED(name_)                 if(index_ == i_++){ os_ <<name_; return; }
+#define FIELD_UNSIGNED(name_)               if(index_ == i_++){ os_ <<name_; return; }
+#define FIELD_DOUBLE(name_)                 if(index_ == i_++){ os_ <<name_; return; }
+#define FIELD_STRING(name_)                 if(index_ == i_++){ os_ << ::Poseidon::MySql::StringEscaper(name_); return; }
+#define FIELD_DATETIME(name_)               if(index_ == i_++){ os_ << ::Poseidon::MySql::DateTimeFormatter(name_); return; }
+#define FIELD_UUID(name_)                   if(index_ == i_++){ os_ << ::Poseidon::MySql::UuidFormatter(name_); return; }
+#define FIELD_BLOB(name_)                   if(index_ == i_++){ os_ << ::Poseidon::MySql::StringEscaper(name_); return; }
+
+		MYSQL_OBJECT_FIELDS
+		DEBUG_THROW_ASSERT(false);
+	}
+	void bind_sql_field_param(::Poseidon::MySql::StatementParams &params_, ::std::size_t index_) const OVERRIDE {
+		::std::size_t i_ = 0;
+
+#undef FIELD_BOOLEAN
+#undef FIELD_SIGNED
+#undef FIELD_UNSIGNED
+#undef FIELD_DOUBLE
+#undef FIELD_STRING
+#undef FIELD_DATETIME
+#undef FIELD_UUID
+#undef FIELD_BLOB
+
+#define FIELD_BOOLEAN(name_)                if(index_ == i_++){ params_.add_signed(name_.get()); return; }
+#define FIELD_SIGNED(name_)                 if(index_ == i_++){ params_.add_signed(name_.get()); return; }
+#define FIELD_UNSIGNED(name_)               if(index_ == i_++){ params_.add_unsigned(name_.get()); return; }
+#define FIELD_DOUBLE(name_)                 if(index_ == i_++){ params_.add_double(name_.get()); return; }
+#define FIELD_STRING(name_)                 if(index_ == i_++){ params_.add_string(name_.get()); return; }
+#define FIELD_DATETIME(name_)               if(index_ == i_++){ params_.add_datetime(name_.get()); return; }
+#define FIELD_UUID(name_)                   if(index_ == i_++){ params_.add_uuid(name_.get()); return; }
+#define FIELD_BLOB(name_)                   if(index_ == i_++){ params_.add_string(name_.get()); return; }
+
+		MYSQL_OBJECT_FIELDS
+		DEBUG_THROW_ASSERT(false);
+	}
 	void fetch(const ::boost::shared_ptr<const ::Poseidon::MySql::Connection> &conn_) OVERRIDE {
+		// 列的下标每个结果集只查找一次。
+		const ::std::size_t *const indices_ = conn_->get_field_indices(get_field_names_(), get_field_count());
+		::std::size_t i_ = 0;
 
 #undef FIELD_BOOLEAN
 #undef FIELD_SIGNED
@@ -160,14 +341,14 @@ public:
 #undef FIELD_UUID
 #undef FIELD_BLOB
 
-#define FIELD_BOOLEAN(name_)                name_.set(conn_->get_signed   ( TOKEN_TO_STR(name_) ), false);
-#define FIELD_SIGNED(name_)                 name_.set(conn_->get_signed   ( TOKEN_TO_STR(name_) ), false);
-#define FIELD_UNSIGNED(name_)               name_.set(conn_->get_unsigned ( TOKEN_TO_STR(name_) ), false);
-#define FIELD_DOUBLE(name_)                 name_.set(conn_->get_double   ( TOKEN_TO_STR(name_) ), false);
-#define FIELD_STRING(name_)                 name_.set(conn_->get_string   ( TOKEN_TO_STR(name_) ), false);
-#define FIELD_DATETIME(name_)               name_.set(conn_->get_datetime ( TOKEN_TO_STR(name_) ), false);
-#define FIELD_UUID(name_)                   name_.set(conn_->get_uuid     ( TOKEN_TO_STR(name_) ), false);
-#define FIELD_BLOB(name_)                   name_.set(conn_->get_string   ( TOKEN_TO_STR(name_) ), false);
+#define FIELD_BOOLEAN(name_)                name_.set(conn_->get_signed   (indices_[i_++]), false);
+#define FIELD_SIGNED(name_)                 name_.set(conn_->get_signed   (indices_[i_++]), false);
+#define FIELD_UNSIGNED(name_)               name_.set(conn_->get_unsigned (indices_[i_++]), false);
+#define FIELD_DOUBLE(name_)                 name_.set(conn_->get_double   (indices_[i_++]), false);
+#define FIELD_STRING(name_)                 name_.set(conn_->get_string   (indices_[i_++]), false);
+#define FIELD_DATETIME(name_)               name_.set(conn_->get_datetime (indices_[i_++]), false);
+#define FIELD_UUID(name_)                   name_.set(conn_->get_uuid     (indices_[i_++]), false);
+#define FIELD_BLOB(name_)                   name_.set(conn_->get_string   (indices_[i_++]), false);
 
 		MYSQL_OBJECT_FIELDS
 	}
@@ -128,19 +128,20 @@ namespace {
 		PROFILE_ME;
 		LOG_POSEIDON_INFO("DNS daemon started.");
 
-		unsigned timeout = 0;
 		for(;;){
 			bool busy;
 			do {
 				busy = pump_one_element();
-				timeout = std::min(timeout * 2u + 1u, !busy * 100u);
 			} while(busy);
 
 			Mutex::UniqueLock lock(g_mutex);
 			if(!atomic_load(g_running, ATOMIC_CONSUME)){
 				break;
 			}
-			g_new_operation.timed_wait(lock, timeout);
+			// 必须在锁内重新检查队列，否则在此之前投递的操作的通知会丢失。
+			if(g_operations.empty()){
+				g_new_operation.wait(lock);
+			}
 		}
 
 		LOG_POSEIDON_INFO("DNS daemon stopped.");
@@ -162,6 +163,10 @@ void DnsDaemon::stop(){
 	}
 	LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO, "Stopping DNS daemon...");
 
+	{
+		const Mutex::UniqueLock lock(g_mutex);
+		g_new_operation.signal();
+	}
 	if(g_thread.joinable()){
 		g_thread.join();
 	}
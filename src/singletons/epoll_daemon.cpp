@@ -6,13 +6,18 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <climits>
 #include <errno.h>
 #include "job_dispatcher.hpp"
+#include "main_config.hpp"
 #include "../thread.hpp"
 #include "../log.hpp"
 #include "../atomic.hpp"
 #include "../time.hpp"
 #include "../socket_base.hpp"
+#include "../tcp_session_base.hpp"
 #include "../profiler.hpp"
 #include "../recursive_mutex.hpp"
 #include "../raii.hpp"
@@ -24,8 +29,9 @@
 namespace Poseidon {
 
 namespace {
+	std::size_t g_thread_count = 1;
+
 	volatile bool g_running = false;
-	Thread g_thread;
 
 	struct SocketElement {
 		boost::shared_ptr<SocketBase> socket;
@@ -50,199 +56,381 @@ namespace {
 		MULTI_MEMBER_INDEX(write_time)
 	)
 
-	RecursiveMutex g_mutex;
-	UniqueFile g_epoll;
-	SocketMap g_socket_map;
+	class Reactor;
+
+	__thread Reactor *t_current_reactor;
+
+	// 每个 Reactor 拥有独立的 epoll 和套接字表，仅由自身的线程泵送。
+	class Reactor : NONCOPYABLE {
+	private:
+		const std::size_t m_index;
 
-	bool pump_readable_sockets() NOEXCEPT {
-		PROFILE_ME;
+		Thread m_thread;
 
-		std::vector<VALUE_TYPE(g_socket_map.begin<1>())> iterators;
-		const AUTO(now, get_fast_mono_clock());
+		mutable RecursiveMutex m_mutex;
+		UniqueFile m_epoll;
+		SocketMap m_socket_map;
+		bool m_stopped; // safe_join() 之后不再接受新的套接字。
+
+		// 其他线程通过 eventfd 打断 epoll_wait()。
+		UniqueFile m_wakeup;
+		volatile bool m_wakeup_pending;
+
+	public:
+		explicit Reactor(std::size_t index)
+			: m_index(index)
+			, m_stopped(false)
+			, m_wakeup_pending(false)
 		{
-			const RecursiveMutex::UniqueLock lock(g_mutex);
-			const AUTO(range, std::make_pair(g_socket_map.begin<1>(), g_socket_map.upper_bound<1>(now)));
-			try {
-				iterators.reserve(static_cast<std::size_t>(std::distance(range.first, range.second)));
-				for(AUTO(it, range.first); it != range.second; ++it){
-					iterators.push_back(it);
+			if(!m_epoll.reset(::epoll_create(4096))){
+				const int err_code = errno;
+				LOG_POSEIDON_FATAL("Failed to create epoll! errno was ", err_code);
+				std::abort();
+			}
+			if(!m_wakeup.reset(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))){
+				const int err_code = errno;
+				LOG_POSEIDON_FATAL("Failed to create eventfd! errno was ", err_code);
+				std::abort();
+			}
+			::epoll_event event = { };
+			event.events = EPOLLIN;
+			event.data.fd = m_wakeup.get();
+			if(::epoll_ctl(m_epoll.get(), EPOLL_CTL_ADD, m_wakeup.get(), &event) != 0){
+				const int err_code = errno;
+				LOG_POSEIDON_FATAL("Failed to add eventfd to epoll! errno was ", err_code);
+				std::abort();
+			}
+		}
+
+	private:
+		bool pump_readable_sockets() NOEXCEPT {
+			PROFILE_ME;
+
+			std::vector<VALUE_TYPE(m_socket_map.begin<1>())> iterators;
+			const AUTO(now, get_fast_mono_clock());
+			{
+				const RecursiveMutex::UniqueLock lock(m_mutex);
+				const AUTO(range, std::make_pair(m_socket_map.begin<1>(), m_socket_map.upper_bound<1>(now)));
+				try {
+					iterators.reserve(static_cast<std::size_t>(std::distance(range.first, range.second)));
+					for(AUTO(it, range.first); it != range.second; ++it){
+						iterators.push_back(it);
+					}
+				} catch(std::exception &e){
+					LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
+					return false;
 				}
-			} catch(std::exception &e){
-				LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
+			}
+			if(iterators.empty()){
 				return false;
 			}
+			for(AUTO(iit, iterators.begin()); iit != iterators.end(); ++iit){
+				const AUTO(it, *iit);
+				if(it->socket->is_throttled()){
+					LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_DEBUG,
+						"Session is throttled: typeid = ", typeid(*(it->socket)).name());
+					const RecursiveMutex::UniqueLock lock(m_mutex);
+					m_socket_map.set_key<1, 1>(it, now + 5000);
+					continue;
+				}
+				try {
+					const int err_code = it->socket->poll_read_and_process(it->readable);
+					if((err_code != 0) && (err_code != EINTR)){
+						if(err_code == EWOULDBLOCK){
+							const RecursiveMutex::UniqueLock lock(m_mutex);
+							m_socket_map.set_key<1, 1>(it, (boost::uint64_t)-1);
+							continue;
+						}
+						DEBUG_THROW(SystemException, err_code);
+					}
+				} catch(std::exception &e){
+					LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO,
+						"std::exception thrown: what = ", e.what(), ", typeid = ", typeid(*(it->socket)).name());
+					it->socket->force_shutdown();
+					const RecursiveMutex::UniqueLock lock(m_mutex);
+					m_socket_map.erase<1>(it);
+					continue;
+				} catch(...){
+					LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO,
+						"Unknown exception thrown: typeid = ", typeid(*(it->socket)).name());
+					it->socket->force_shutdown();
+					const RecursiveMutex::UniqueLock lock(m_mutex);
+					m_socket_map.erase<1>(it);
+					continue;
+				}
+			}
+			return true;
 		}
-		if(iterators.empty()){
-			return false;
-		}
-		for(AUTO(iit, iterators.begin()); iit != iterators.end(); ++iit){
-			const AUTO(it, *iit);
-			if(it->socket->is_throttled()){
-				LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_DEBUG,
-					"Session is throttled: typeid = ", typeid(*(it->socket)).name());
-				const RecursiveMutex::UniqueLock lock(g_mutex);
-				g_socket_map.set_key<1, 1>(it, now + 5000);
-				continue;
+
+		bool pump_writeable_sockets() NOEXCEPT {
+			PROFILE_ME;
+
+			std::vector<VALUE_TYPE(m_socket_map.begin<2>())> iterators;
+			const AUTO(now, get_fast_mono_clock());
+			{
+				const RecursiveMutex::UniqueLock lock(m_mutex);
+				const AUTO(range, std::make_pair(m_socket_map.begin<2>(), m_socket_map.upper_bound<2>(now)));
+				try {
+					iterators.reserve(static_cast<std::size_t>(std::distance(range.first, range.second)));
+					for(AUTO(it, range.first); it != range.second; ++it){
+						iterators.push_back(it);
+					}
+				} catch(std::exception &e){
+					LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
+					return false;
+				}
 			}
-			try {
-				const int err_code = it->socket->poll_read_and_process(it->readable);
-				if((err_code != 0) && (err_code != EINTR)){
-					if(err_code == EWOULDBLOCK){
-						const RecursiveMutex::UniqueLock lock(g_mutex);
-						g_socket_map.set_key<1, 1>(it, (boost::uint64_t)-1);
-						continue;
+			if(iterators.empty()){
+				return false;
+			}
+			for(AUTO(iit, iterators.begin()); iit != iterators.end(); ++iit){
+				const AUTO(it, *iit);
+				try {
+					Mutex::UniqueLock write_lock;
+					const int err_code = it->socket->poll_write(write_lock, it->writeable);
+					if((err_code != 0) && (err_code != EINTR)){
+						if(err_code == EWOULDBLOCK){
+							const RecursiveMutex::UniqueLock lock(m_mutex);
+							m_socket_map.set_key<2, 2>(it, (boost::uint64_t)-1);
+							continue;
+						}
+						DEBUG_THROW(SystemException, err_code);
 					}
-					DEBUG_THROW(SystemException, err_code);
+				} catch(std::exception &e){
+					LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO,
+						"std::exception thrown: what = ", e.what(), ", typeid = ", typeid(*(it->socket)).name());
+					it->socket->force_shutdown();
+					const RecursiveMutex::UniqueLock lock(m_mutex);
+					m_socket_map.erase<2>(it);
+					continue;
+				} catch(...){
+					LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO,
+						"Unknown exception thrown: typeid = ", typeid(*(it->socket)).name());
+					it->socket->force_shutdown();
+					const RecursiveMutex::UniqueLock lock(m_mutex);
+					m_socket_map.erase<2>(it);
+					continue;
 				}
-			} catch(std::exception &e){
-				LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO,
-					"std::exception thrown: what = ", e.what(), ", typeid = ", typeid(*(it->socket)).name());
-				it->socket->force_shutdown();
-				const RecursiveMutex::UniqueLock lock(g_mutex);
-				g_socket_map.erase<1>(it);
-				continue;
-			} catch(...){
-				LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO,
-					"Unknown exception thrown: typeid = ", typeid(*(it->socket)).name());
-				it->socket->force_shutdown();
-				const RecursiveMutex::UniqueLock lock(g_mutex);
-				g_socket_map.erase<1>(it);
-				continue;
 			}
+			return true;
 		}
-		return true;
-	}
 
-	bool pump_writeable_sockets() NOEXCEPT {
-		PROFILE_ME;
+		// 返回距离下一个套接字需要泵送的毫秒数，-1 表示无限等待。
+		int get_wait_timeout() const NOEXCEPT {
+			// JobDispatcher 未运行时不泵送可读的套接字，只能定期检查其状态。
+			const bool pumps_readable = JobDispatcher::is_running();
 
-		std::vector<VALUE_TYPE(g_socket_map.begin<2>())> iterators;
-		const AUTO(now, get_fast_mono_clock());
-		{
-			const RecursiveMutex::UniqueLock lock(g_mutex);
-			const AUTO(range, std::make_pair(g_socket_map.begin<2>(), g_socket_map.upper_bound<2>(now)));
-			try {
-				iterators.reserve(static_cast<std::size_t>(std::distance(range.first, range.second)));
-				for(AUTO(it, range.first); it != range.second; ++it){
-					iterators.push_back(it);
+			const AUTO(now, get_fast_mono_clock());
+			boost::uint64_t next = pumps_readable ? (boost::uint64_t)-1 : saturated_add<boost::uint64_t>(now, 100);
+			{
+				const RecursiveMutex::UniqueLock lock(m_mutex);
+				if(!m_socket_map.empty()){
+					if(pumps_readable){
+						next = std::min(next, m_socket_map.begin<1>()->read_time);
+					}
+					next = std::min(next, m_socket_map.begin<2>()->write_time);
 				}
-			} catch(std::exception &e){
-				LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
-				return false;
 			}
+			if(next == (boost::uint64_t)-1){
+				return -1;
+			}
+			if(next <= now){
+				return 0;
+			}
+			return static_cast<int>(std::min<boost::uint64_t>(next - now, INT_MAX));
 		}
-		if(iterators.empty()){
-			return false;
+
+		void consume_wakeup() NOEXCEPT {
+			boost::uint64_t value;
+			if(::read(m_wakeup.get(), &value, sizeof(value)) < 0){
+				const int err_code = errno;
+				if(err_code != EAGAIN){
+					LOG_POSEIDON_WARNING("::read() failed on eventfd! errno was ", err_code);
+				}
+			}
+			// 必须在读取之后才能清除标记，否则清除标记之后、读取之前的唤醒会丢失。
+			atomic_store(m_wakeup_pending, false, ATOMIC_RELEASE);
 		}
-		for(AUTO(iit, iterators.begin()); iit != iterators.end(); ++iit){
-			const AUTO(it, *iit);
-			try {
-				Mutex::UniqueLock write_lock;
-				const int err_code = it->socket->poll_write(write_lock, it->writeable);
-				if((err_code != 0) && (err_code != EINTR)){
-					if(err_code == EWOULDBLOCK){
-						const RecursiveMutex::UniqueLock lock(g_mutex);
-						g_socket_map.set_key<2, 2>(it, (boost::uint64_t)-1);
-						continue;
+
+		bool wait_for_sockets(int timeout) NOEXCEPT {
+			PROFILE_ME;
+
+			::epoll_event events[256];
+			const int result = ::epoll_wait(m_epoll.get(), events, COUNT_OF(events), timeout);
+			if(result < 0){
+				const int err_code = errno;
+				if(err_code != EINTR){
+					LOG_POSEIDON_ERROR("::epoll_wait() failed! errno was ", err_code);
+				}
+				return false;
+			}
+			if(result == 0){
+				return false;
+			}
+			const AUTO(now, Poseidon::get_fast_mono_clock());
+			const RecursiveMutex::UniqueLock lock(m_mutex);
+			for(unsigned i = 0; i < (unsigned)result; ++i){
+				if(events[i].data.fd == m_wakeup.get()){
+					consume_wakeup();
+					continue;
+				}
+				const AUTO(it, m_socket_map.find<0>(events[i].data.fd));
+				if(it == m_socket_map.end()){
+					LOG_POSEIDON_DEBUG("Socket reported by epoll is not registered: fd = ", events[i].data.fd);
+					continue;
+				}
+				if(events[i].events & (EPOLLHUP | EPOLLERR)){
+					int err_code;
+					if(it->socket->was_timed_out()){
+						err_code = ETIMEDOUT;
+					} else if(events[i].events & EPOLLERR){
+						::socklen_t err_len = sizeof(err_code);
+						if(::getsockopt(it->socket->get_fd(), SOL_SOCKET, SO_ERROR, &err_code, &err_len) != 0){
+							err_code = errno;
+							LOG_POSEIDON_WARNING("::getsockopt() failed, errno was ", err_code, ": fd = ", it->socket->get_fd());
+						}
+					} else {
+						err_code = 0;
 					}
-					DEBUG_THROW(SystemException, err_code);
+					LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_DEBUG,
+						"Socket closed: err_code = ", err_code, ", desc = ", get_error_desc(err_code), ", typeid = ", typeid(*(it->socket)).name());
+					it->socket->shutdown_read();
+					it->socket->shutdown_write();
+					it->socket->on_close(err_code);
+					m_socket_map.erase<0>(it);
+					continue;
+				}
+				if(events[i].events & EPOLLIN){
+					it->readable = true;
+					m_socket_map.set_key<0, 1>(it, now);
+				}
+				if(events[i].events & EPOLLOUT){
+					it->writeable = true;
+					m_socket_map.set_key<0, 2>(it, now);
 				}
-			} catch(std::exception &e){
-				LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO,
-					"std::exception thrown: what = ", e.what(), ", typeid = ", typeid(*(it->socket)).name());
-				it->socket->force_shutdown();
-				const RecursiveMutex::UniqueLock lock(g_mutex);
-				g_socket_map.erase<2>(it);
-				continue;
-			} catch(...){
-				LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO,
-					"Unknown exception thrown: typeid = ", typeid(*(it->socket)).name());
-				it->socket->force_shutdown();
-				const RecursiveMutex::UniqueLock lock(g_mutex);
-				g_socket_map.erase<2>(it);
-				continue;
 			}
+			return true;
 		}
-		return true;
-	}
 
-	bool wait_for_sockets(unsigned timeout) NOEXCEPT {
-		PROFILE_ME;
+		void thread_proc(){
+			PROFILE_ME;
+			LOG_POSEIDON_INFO("Epoll reactor ", m_index, " started.");
+
+			t_current_reactor = this;
 
-		::epoll_event events[256];
-		const int result = ::epoll_wait(g_epoll.get(), events, COUNT_OF(events), (int)timeout);
-		if(result < 0){
-			const int err_code = errno;
-			if(err_code != EINTR){
-				LOG_POSEIDON_ERROR("::epoll_wait() failed! errno was ", err_code);
+			for(;;){
+				bool busy;
+				do {
+					busy = wait_for_sockets(0);
+					busy += JobDispatcher::is_running() && pump_readable_sockets();
+					busy += pump_writeable_sockets();
+				} while(busy);
+
+				if(!atomic_load(g_running, ATOMIC_CONSUME)){
+					break;
+				}
+				wait_for_sockets(get_wait_timeout());
 			}
-			return false;
+
+			t_current_reactor = NULLPTR;
+
+			LOG_POSEIDON_INFO("Epoll reactor ", m_index, " stopped.");
 		}
-		if(result == 0){
-			return false;
+
+	public:
+		void start(){
+			Thread(boost::bind(&Reactor::thread_proc, this), "   N").swap(m_thread);
 		}
-		const AUTO(now, Poseidon::get_fast_mono_clock());
-		const RecursiveMutex::UniqueLock lock(g_mutex);
-		for(unsigned i = 0; i < (unsigned)result; ++i){
-			const AUTO(it, g_socket_map.find<0>(events[i].data.fd));
-			if(it == g_socket_map.end()){
-				LOG_POSEIDON_DEBUG("Socket reported by epoll is not registered: fd = ", events[i].data.fd);
-				continue;
+		void wake() NOEXCEPT {
+			// 在自己的线程中无需唤醒，泵送循环结束之前会再次检查所有套接字。
+			if(t_current_reactor == this){
+				return;
 			}
-			if(events[i].events & (EPOLLHUP | EPOLLERR)){
-				int err_code;
-				if(it->socket->was_timed_out()){
-					err_code = ETIMEDOUT;
-				} else if(events[i].events & EPOLLERR){
-					::socklen_t err_len = sizeof(err_code);
-					if(::getsockopt(it->socket->get_fd(), SOL_SOCKET, SO_ERROR, &err_code, &err_len) != 0){
-						err_code = errno;
-						LOG_POSEIDON_WARNING("::getsockopt() failed, errno was ", err_code, ": fd = ", it->socket->get_fd());
-					}
-				} else {
-					err_code = 0;
-				}
-				LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_DEBUG,
-					"Socket closed: err_code = ", err_code, ", desc = ", get_error_desc(err_code), ", typeid = ", typeid(*(it->socket)).name());
-				it->socket->shutdown_read();
-				it->socket->shutdown_write();
-				it->socket->on_close(err_code);
-				g_socket_map.erase<0>(it);
-				continue;
+			if(atomic_exchange(m_wakeup_pending, true, ATOMIC_ACQ_REL) != false){
+				return;
 			}
-			if(events[i].events & EPOLLIN){
-				it->readable = true;
-				g_socket_map.set_key<0, 1>(it, now);
+			const boost::uint64_t value = 1;
+			if(::write(m_wakeup.get(), &value, sizeof(value)) < 0){
+				const int err_code = errno;
+				if(err_code != EAGAIN){
+					LOG_POSEIDON_WARNING("::write() failed on eventfd! errno was ", err_code);
+				}
 			}
-			if(events[i].events & EPOLLOUT){
-				it->writeable = true;
-				g_socket_map.set_key<0, 2>(it, now);
+		}
+
+		void safe_join(){
+			wake();
+			if(m_thread.joinable()){
+				m_thread.join();
 			}
+			const RecursiveMutex::UniqueLock lock(m_mutex);
+			m_socket_map.clear();
+			m_stopped = true;
 		}
-		return true;
-	}
 
-	void thread_proc(){
-		PROFILE_ME;
-		LOG_POSEIDON_INFO("Epoll daemon started.");
-
-		unsigned timeout = 0;
-		for(;;){
-			bool busy;
-			do {
-				busy = wait_for_sockets(0);
-				busy += JobDispatcher::is_running() && pump_readable_sockets();
-				busy += pump_writeable_sockets();
-				timeout = std::min(timeout * 2u + 1u, !busy * 100u);
-			} while(busy);
-
-			if(!atomic_load(g_running, ATOMIC_CONSUME)){
-				break;
+		void make_snapshot(std::vector<EpollDaemon::SnapshotElement> &snapshot, boost::uint64_t now) const {
+			const RecursiveMutex::UniqueLock lock(m_mutex);
+			snapshot.reserve(snapshot.size() + m_socket_map.size());
+			for(AUTO(it, m_socket_map.begin()); it != m_socket_map.end(); ++it){
+				EpollDaemon::SnapshotElement elem;
+				elem.remote = it->socket->get_remote_info();
+				elem.local = it->socket->get_local_info();
+				elem.ms_online = saturated_sub(now, it->socket->get_creation_time());
+				snapshot.push_back(STD_MOVE(elem));
 			}
-			wait_for_sockets(timeout);
 		}
+		void add_socket(const boost::shared_ptr<SocketBase> &socket){
+			const RecursiveMutex::UniqueLock lock(m_mutex);
+			if(m_stopped){
+				LOG_POSEIDON_ERROR("Epoll daemon is not running.");
+				DEBUG_THROW(Exception, sslit("Epoll daemon is not running"));
+			}
+			const AUTO(result, m_socket_map.insert(SocketElement(socket)));
+			if(!result.second){
+				LOG_POSEIDON_ERROR("Socket is already in epoll: socket = ", socket,
+					", typeid = ", typeid(*socket).name(), ", fd = ", socket->get_fd());
+				DEBUG_THROW(Exception, sslit("Socket is already in epoll"));
+			}
+			try {
+				::epoll_event event = { };
+				event.events = static_cast< ::uint32_t>(EPOLLIN | EPOLLOUT | EPOLLET);
+				event.data.fd = socket->get_fd();
+				if(::epoll_ctl(m_epoll.get(), EPOLL_CTL_ADD, socket->get_fd(), &event) != 0){
+					const int err_code = errno;
+					LOG_POSEIDON_ERROR("::epoll_ctl() failed, errno was ", err_code, ": socket = ", socket,
+						", typeid = ", typeid(*socket).name(), ", fd = ", socket->get_fd());
+					DEBUG_THROW(SystemException, err_code);
+				}
+			} catch(...){
+				m_socket_map.erase(result.first);
+				throw;
+			}
+			LOG_POSEIDON_TRACE("Socket added to epoll reactor ", m_index, ": fd = ", socket->get_fd());
+		}
+		bool mark_socket_writeable(int fd) NOEXCEPT {
+			const RecursiveMutex::UniqueLock lock(m_mutex);
+			const AUTO(it, m_socket_map.find<0>(fd));
+			if(it == m_socket_map.end()){
+				LOG_POSEIDON_DEBUG("Socket not found in epoll: fd = ", fd);
+				return false;
+			}
+			const AUTO(now, get_fast_mono_clock());
+			m_socket_map.set_key<0, 2>(it, now);
+			wake();
+			return true;
+		}
+	};
+
+	// 只在 start() 中填充。stop() 只停止各个 Reactor 而不释放它们，因为任务线程和定时器线程
+	// 可能在此之后仍然调用 mark_socket_writeable()。因此访问时无需加锁。
+	std::vector<boost::shared_ptr<Reactor> > g_reactors;
 
-		LOG_POSEIDON_INFO("Epoll daemon stopped.");
+	// 套接字按照 fd 分配给 Reactor，这样无需额外的查找表即可由 fd 找到其所在的 Reactor。
+	Reactor *get_reactor(int fd) NOEXCEPT {
+		if(g_reactors.empty()){
+			return NULLPTR;
+		}
+		return g_reactors[static_cast<unsigned>(fd) % g_reactors.size()].get();
 	}
 }
 
@@ -253,12 +441,19 @@ void EpollDaemon::start(){
 	}
 	LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO, "Starting epoll daemon...");
 
-	if(!g_epoll.reset(::epoll_create(4096))){
-		const int err_code = errno;
-		LOG_POSEIDON_FATAL("Failed to create epoll! errno was ", err_code);
-		std::abort();
+	MainConfig::get(g_thread_count, "epoll_thread_count");
+	LOG_POSEIDON_DEBUG("Epoll thread count = ", g_thread_count);
+
+	const AUTO(thread_count, std::max<std::size_t>(g_thread_count, 1));
+	// 重新启动时丢弃上次停止的 Reactor。
+	g_reactors.clear();
+	g_reactors.reserve(thread_count);
+	for(std::size_t i = 0; i < thread_count; ++i){
+		g_reactors.push_back(boost::make_shared<Reactor>(i));
+	}
+	for(std::size_t i = 0; i < thread_count; ++i){
+		g_reactors.at(i)->start();
 	}
-	Thread(&thread_proc, "   N").swap(g_thread);
 }
 void EpollDaemon::stop(){
 	if(atomic_exchange(g_running, false, ATOMIC_ACQ_REL) == false){
@@ -266,64 +461,41 @@ void EpollDaemon::stop(){
 	}
 	LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO, "Stopping epoll daemon...");
 
-	if(g_thread.joinable()){
-		g_thread.join();
+	for(std::size_t i = 0; i < g_reactors.size(); ++i){
+		g_reactors.at(i)->safe_join();
 	}
-	g_socket_map.clear();
-	g_epoll.reset();
+	// 计时器要在 TimerDaemon 之前释放。
+	TcpSessionBase::stop_tracking_deadlines();
 }
 
 void EpollDaemon::make_snapshot(std::vector<EpollDaemon::SnapshotElement> &snapshot){
 	PROFILE_ME;
 
 	const AUTO(now, get_fast_mono_clock());
-	const RecursiveMutex::UniqueLock lock(g_mutex);
-	snapshot.reserve(snapshot.size() + g_socket_map.size());
-	for(AUTO(it, g_socket_map.begin()); it != g_socket_map.end(); ++it){
-		SnapshotElement elem;
-		elem.remote = it->socket->get_remote_info();
-		elem.local = it->socket->get_local_info();
-		elem.ms_online = saturated_sub(now, it->socket->get_creation_time());
-		snapshot.push_back(STD_MOVE(elem));
+	for(std::size_t i = 0; i < g_reactors.size(); ++i){
+		g_reactors.at(i)->make_snapshot(snapshot, now);
 	}
 }
 void EpollDaemon::add_socket(const boost::shared_ptr<SocketBase> &socket){
 	PROFILE_ME;
 
-	const RecursiveMutex::UniqueLock lock(g_mutex);
-	const AUTO(result, g_socket_map.insert(SocketElement(socket)));
-	if(!result.second){
-		LOG_POSEIDON_ERROR("Socket is already in epoll: socket = ", socket,
-			", typeid = ", typeid(*socket).name(), ", fd = ", socket->get_fd());
-		DEBUG_THROW(Exception, sslit("Socket is already in epoll"));
-	}
-	try {
-		::epoll_event event = { };
-		event.events = static_cast< ::uint32_t>(EPOLLIN | EPOLLOUT | EPOLLET);
-		event.data.fd = socket->get_fd();
-		if(::epoll_ctl(g_epoll.get(), EPOLL_CTL_ADD, socket->get_fd(), &event) != 0){
-			const int err_code = errno;
-			LOG_POSEIDON_ERROR("::epoll_ctl() failed, errno was ", err_code, ": socket = ", socket,
-				", typeid = ", typeid(*socket).name(), ", fd = ", socket->get_fd());
-			DEBUG_THROW(SystemException, err_code);
-		}
-	} catch(...){
-		g_socket_map.erase(result.first);
-		throw;
+	const AUTO(reactor, get_reactor(socket->get_fd()));
+	if(!reactor){
+		LOG_POSEIDON_ERROR("Epoll daemon is not running.");
+		DEBUG_THROW(Exception, sslit("Epoll daemon is not running"));
 	}
+	reactor->add_socket(socket);
+	socket->on_added_to_epoll();
 }
 bool EpollDaemon::mark_socket_writeable(int fd) NOEXCEPT {
 	PROFILE_ME;
 
-	const RecursiveMutex::UniqueLock lock(g_mutex);
-	const AUTO(it, g_socket_map.find<0>(fd));
-	if(it == g_socket_map.end()){
-		LOG_POSEIDON_DEBUG("Socket not found in epoll: fd = ", fd);
+	const AUTO(reactor, get_reactor(fd));
+	if(!reactor){
+		LOG_POSEIDON_DEBUG("Epoll daemon is not running: fd = ", fd);
 		return false;
 	}
-	const AUTO(now, get_fast_mono_clock());
-	g_socket_map.set_key<0, 2>(it, now);
-	return true;
+	return reactor->mark_socket_writeable(fd);
 }
 
 }
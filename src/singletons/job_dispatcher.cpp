@@ -4,8 +4,11 @@
 #include "../precompiled.hpp"
 #include "job_dispatcher.hpp"
 #include "main_config.hpp"
-#include <ucontext.h>
+#if !defined(__x86_64__) && !defined(__aarch64__)
+#  include <ucontext.h>
+#endif
 #include <sys/mman.h>
+#include <unistd.h>
 #include <errno.h>
 #include <boost/container/map.hpp>
 #include <vector>
@@ -18,8 +21,118 @@
 #include "../mutex.hpp"
 #include "../recursive_mutex.hpp"
 #include "../condition_variable.hpp"
+#include "../thread.hpp"
 #include "../time.hpp"
 #include "../checked_arithmetic.hpp"
+#include "../multi_index_map.hpp"
+
+// 纤程上下文切换。glibc 的 swapcontext() 每次都会调用 rt_sigprocmask 保存和恢复信号掩码，
+// 这里只保存被调用者保存的寄存器，在其他平台上退回到 ucontext。
+#if defined(__x86_64__)
+
+__asm__(
+	".text \n"
+	".p2align 4 \n"
+	".globl poseidon_fiber_switch \n"
+	".hidden poseidon_fiber_switch \n"
+	".type poseidon_fiber_switch, @function \n"
+	"poseidon_fiber_switch: \n" // void (void **from_sp, void *to_sp)
+	"	pushq %rbp \n"
+	"	pushq %rbx \n"
+	"	pushq %r12 \n"
+	"	pushq %r13 \n"
+	"	pushq %r14 \n"
+	"	pushq %r15 \n"
+	"	subq $8, %rsp \n"
+	"	stmxcsr (%rsp) \n"
+	"	fnstcw 4(%rsp) \n"
+	"	movq %rsp, (%rdi) \n"
+	"	movq %rsi, %rsp \n"
+	"	ldmxcsr (%rsp) \n"
+	"	fldcw 4(%rsp) \n"
+	"	addq $8, %rsp \n"
+	"	popq %r15 \n"
+	"	popq %r14 \n"
+	"	popq %r13 \n"
+	"	popq %r12 \n"
+	"	popq %rbx \n"
+	"	popq %rbp \n"
+	"	ret \n"
+	".size poseidon_fiber_switch, .-poseidon_fiber_switch \n"
+	"\n"
+	".p2align 4 \n"
+	".globl poseidon_fiber_entry \n"
+	".hidden poseidon_fiber_entry \n"
+	".type poseidon_fiber_entry, @function \n"
+	"poseidon_fiber_entry: \n" // r12 = param, r13 = proc
+	"	.cfi_startproc \n"
+	"	.cfi_undefined rip \n"
+	"	movq %r12, %rdi \n"
+	"	callq *%r13 \n"
+	"	ud2 \n"
+	"	.cfi_endproc \n"
+	".size poseidon_fiber_entry, .-poseidon_fiber_entry \n"
+);
+
+#elif defined(__aarch64__)
+
+__asm__(
+	".text \n"
+	".p2align 4 \n"
+	".globl poseidon_fiber_switch \n"
+	".hidden poseidon_fiber_switch \n"
+	".type poseidon_fiber_switch, %function \n"
+	"poseidon_fiber_switch: \n" // void (void **from_sp, void *to_sp)
+	"	sub sp, sp, #160 \n"
+	"	stp x19, x20, [sp, #0] \n"
+	"	stp x21, x22, [sp, #16] \n"
+	"	stp x23, x24, [sp, #32] \n"
+	"	stp x25, x26, [sp, #48] \n"
+	"	stp x27, x28, [sp, #64] \n"
+	"	stp x29, x30, [sp, #80] \n"
+	"	stp d8, d9, [sp, #96] \n"
+	"	stp d10, d11, [sp, #112] \n"
+	"	stp d12, d13, [sp, #128] \n"
+	"	stp d14, d15, [sp, #144] \n"
+	"	mov x2, sp \n"
+	"	str x2, [x0] \n"
+	"	mov sp, x1 \n"
+	"	ldp x19, x20, [sp, #0] \n"
+	"	ldp x21, x22, [sp, #16] \n"
+	"	ldp x23, x24, [sp, #32] \n"
+	"	ldp x25, x26, [sp, #48] \n"
+	"	ldp x27, x28, [sp, #64] \n"
+	"	ldp x29, x30, [sp, #80] \n"
+	"	ldp d8, d9, [sp, #96] \n"
+	"	ldp d10, d11, [sp, #112] \n"
+	"	ldp d12, d13, [sp, #128] \n"
+	"	ldp d14, d15, [sp, #144] \n"
+	"	add sp, sp, #160 \n"
+	"	ret \n"
+	".size poseidon_fiber_switch, .-poseidon_fiber_switch \n"
+	"\n"
+	".p2align 4 \n"
+	".globl poseidon_fiber_entry \n"
+	".hidden poseidon_fiber_entry \n"
+	".type poseidon_fiber_entry, %function \n"
+	"poseidon_fiber_entry: \n" // x19 = param, x20 = proc
+	"	.cfi_startproc \n"
+	"	.cfi_undefined x30 \n"
+	"	mov x0, x19 \n"
+	"	blr x20 \n"
+	"	brk #0 \n"
+	"	.cfi_endproc \n"
+	".size poseidon_fiber_entry, .-poseidon_fiber_entry \n"
+);
+
+#endif
+
+#if defined(__x86_64__) || defined(__aarch64__)
+extern "C" {
+	void poseidon_fiber_switch(void **from_sp, void *to_sp);
+	void poseidon_fiber_entry();
+}
+#endif
 
 namespace Poseidon {
 
@@ -49,83 +162,254 @@ namespace {
 
 	class FiberStackAllocator : NONCOPYABLE {
 	public:
-		struct Storage FINAL {
-			static void *operator new(std::size_t cb){
-				assert(cb == sizeof(Storage));
-				(void)cb;
-
-				const AUTO(ptr, mmap(NULLPTR, sizeof(Storage),
-					PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_GROWSDOWN | MAP_STACK, -1, 0));
+		// 栈底有一个 PROT_NONE 的保护页，栈溢出会导致段错误而不是破坏相邻的内存。
+		// 内存在使用时才会被提交，因此可以配置较大的栈。
+		class Stack : NONCOPYABLE {
+		private:
+			void *m_map;
+			std::size_t m_guard_size;
+			std::size_t m_size;
+			std::size_t m_high_water;
+
+		public:
+			Stack(std::size_t guard_size, std::size_t size)
+				: m_map(NULLPTR), m_guard_size(guard_size), m_size(size), m_high_water(0)
+			{
+				const AUTO(ptr, ::mmap(NULLPTR, m_guard_size + m_size,
+					PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0));
 				if(ptr == MAP_FAILED){
 					const int err_code = errno;
 					LOG_POSEIDON_ERROR("Failed to allocate stack: err_code = ", err_code);
 					throw std::bad_alloc();
 				}
-				return ptr;
+				if(::mprotect(ptr, m_guard_size, PROT_NONE) != 0){
+					const int err_code = errno;
+					LOG_POSEIDON_ERROR("Failed to protect stack guard page: err_code = ", err_code);
+					::munmap(ptr, m_guard_size + m_size);
+					throw std::bad_alloc();
+				}
+				m_map = ptr;
 			}
-			static void operator delete(void *ptr) NOEXCEPT {
-				if(::munmap(ptr, sizeof(Storage)) != 0){
+			~Stack(){
+				if(::munmap(m_map, m_guard_size + m_size) != 0){
 					const int err_code = errno;
 					LOG_POSEIDON_ERROR("Failed to deallocate stack: err_code = ", err_code);
 					std::abort();
 				}
 			}
 
-			char bytes[256 * 1024];
+		public:
+			void *get_base() const NOEXCEPT {
+				return static_cast<char *>(m_map) + m_guard_size;
+			}
+			std::size_t get_size() const NOEXCEPT {
+				return m_size;
+			}
+			std::size_t get_high_water() const NOEXCEPT {
+				return m_high_water;
+			}
+
+			// 栈向低地址增长，最低的已提交页面就是曾经使用过的最深位置。
+			std::size_t update_high_water(std::size_t page_size) NOEXCEPT {
+				const AUTO(base, static_cast<unsigned char *>(get_base()));
+				const std::size_t page_count = m_size / page_size;
+				unsigned char resident[256];
+				std::size_t page_index = 0;
+				while(page_index < page_count){
+					const std::size_t batch = std::min(page_count - page_index, sizeof(resident));
+					if(::mincore(base + page_index * page_size, batch * page_size, resident) != 0){
+						const int err_code = errno;
+						LOG_POSEIDON_WARNING("::mincore() failed: err_code = ", err_code);
+						return m_high_water;
+					}
+					for(std::size_t i = 0; i < batch; ++i){
+						if(resident[i] & 1){
+							m_high_water = std::max(m_high_water, (page_count - page_index - i) * page_size);
+							return m_high_water;
+						}
+					}
+					page_index += batch;
+				}
+				return m_high_water;
+			}
 		};
 
 #ifdef POSEIDON_CXX11
-		typedef std::unique_ptr<Storage> StoragePtr;
+		typedef std::unique_ptr<Stack> StackPtr;
 #else
-		typedef boost::shared_ptr<Storage> StoragePtr;
+		typedef boost::shared_ptr<Stack> StackPtr;
 #endif
 
 	private:
 		mutable Mutex m_mutex;
-		boost::array<StoragePtr, 64> m_pool;
-		std::size_t m_size;
+		std::size_t m_page_size;
+		std::size_t m_stack_size;
+		std::size_t m_pool_capacity;
+		std::vector<StackPtr> m_pool;
+		std::size_t m_high_water;
 
 	public:
 		FiberStackAllocator()
-			: m_mutex(), m_pool(), m_size(0)
+			: m_mutex(), m_page_size(4096), m_stack_size(256 * 1024), m_pool_capacity(64), m_pool(), m_high_water(0)
 		{
 		}
 
 	public:
-		StoragePtr allocate(){
-			StoragePtr ptr;
+		// 只能在没有纤程时调用。
+		void reset(std::size_t stack_size, std::size_t pool_capacity){
+			const Mutex::UniqueLock lock(m_mutex);
+			const long page_size = ::sysconf(_SC_PAGESIZE);
+			if(page_size > 0){
+				m_page_size = static_cast<std::size_t>(page_size);
+			}
+			m_stack_size = std::max<std::size_t>((stack_size + m_page_size - 1) / m_page_size * m_page_size, m_page_size * 4);
+			m_pool_capacity = pool_capacity;
+			m_pool.clear();
+			m_pool.reserve(m_pool_capacity);
+			m_high_water = 0;
+		}
+
+		std::size_t get_stack_size() const {
+			const Mutex::UniqueLock lock(m_mutex);
+			return m_stack_size;
+		}
+		std::size_t get_high_water() const {
+			const Mutex::UniqueLock lock(m_mutex);
+			return m_high_water;
+		}
+
+		StackPtr allocate(){
+			StackPtr ptr;
 			const Mutex::UniqueLock lock(m_mutex);
-			if(m_size == 0){
-				ptr.reset(new Storage);
+			if(m_pool.empty()){
+				ptr.reset(new Stack(m_page_size, m_stack_size));
 			} else {
-				ptr = STD_MOVE(m_pool.at(--m_size));
+				ptr = STD_MOVE(m_pool.back());
+				m_pool.pop_back();
 			}
 			return ptr;
 		}
-		void deallocate(StoragePtr ptr) NOEXCEPT {
+		void deallocate(StackPtr ptr) NOEXCEPT {
+			record_usage(*ptr);
+
 			const Mutex::UniqueLock lock(m_mutex);
-			if(m_size == m_pool.size()){
+			if((m_pool.size() < m_pool_capacity) && (ptr->get_size() == m_stack_size)){
+				m_pool.push_back(STD_MOVE_IDN(ptr));
+			} else {
 				ptr.reset();
+			}
+		}
+
+		// 更新栈的最高使用量，超过历史记录时输出日志。
+		void record_usage(Stack &stack) NOEXCEPT {
+			const AUTO(high_water, stack.update_high_water(m_page_size));
+			const Mutex::UniqueLock lock(m_mutex);
+			if(high_water <= m_high_water){
+				return;
+			}
+			m_high_water = high_water;
+			if(high_water >= stack.get_size() / 4 * 3){
+				LOG_POSEIDON_WARNING("Fiber stack usage is approaching the limit: high_water = ", high_water, ", size = ", stack.get_size());
 			} else {
-				m_pool.at(m_size++) = STD_MOVE(ptr);
+				LOG_POSEIDON_DEBUG("Fiber stack high-water mark: high_water = ", high_water, ", size = ", stack.get_size());
 			}
 		}
 	} g_stack_allocator;
 
+	struct FiberContext {
+#if defined(__x86_64__) || defined(__aarch64__)
+		void *sp;
+#else
+		::ucontext_t uc;
+		void (*proc)(void *);
+		void *param;
+#endif
+	};
+
+#if defined(__x86_64__) || defined(__aarch64__)
+	void init_fiber_context(FiberContext &ctx, void *stack, std::size_t size, void (*proc)(void *), void *param) NOEXCEPT {
+		AUTO(top, reinterpret_cast<boost::uintptr_t>(stack) + size);
+		top &= ~static_cast<boost::uintptr_t>(15);
+#  if defined(__x86_64__)
+		// 布局与 poseidon_fiber_switch 压栈的顺序一致：mxcsr 和 x87 控制字、r15、r14、r13、r12、rbx、rbp、返回地址。
+		// 返回到 poseidon_fiber_entry 之后栈指针是 16 字节对齐的，再经过 call 就满足了 ABI 的要求。
+		const AUTO(frame, reinterpret_cast<boost::uint64_t *>(top) - 8);
+		boost::uint32_t csr[2] = { 0x1F80, 0x037F };
+		std::memcpy(frame + 0, csr, sizeof(csr));
+		frame[1] = 0;
+		frame[2] = 0;
+		frame[3] = reinterpret_cast<boost::uint64_t>(proc);
+		frame[4] = reinterpret_cast<boost::uint64_t>(param);
+		frame[5] = 0;
+		frame[6] = 0;
+		frame[7] = reinterpret_cast<boost::uint64_t>(&poseidon_fiber_entry);
+#  else
+		// 布局与 poseidon_fiber_switch 保存的顺序一致：x19 - x30，d8 - d15。
+		const AUTO(frame, reinterpret_cast<boost::uint64_t *>(top) - 20);
+		std::memset(frame, 0, sizeof(boost::uint64_t) * 20);
+		frame[0] = reinterpret_cast<boost::uint64_t>(param);
+		frame[1] = reinterpret_cast<boost::uint64_t>(proc);
+		frame[11] = reinterpret_cast<boost::uint64_t>(&poseidon_fiber_entry);
+#  endif
+		ctx.sp = frame;
+	}
+	inline void switch_fiber_context(FiberContext &from, FiberContext &to) NOEXCEPT {
+		poseidon_fiber_switch(&(from.sp), to.sp);
+	}
+#else
+	void fiber_context_entry(int low, int high) NOEXCEPT {
+		FiberContext *ctx;
+		const int params[2] = { low, high };
+		std::memcpy(&ctx, params, sizeof(ctx));
+		(*(ctx->proc))(ctx->param);
+		std::abort();
+	}
+
+	void init_fiber_context(FiberContext &ctx, void *stack, std::size_t size, void (*proc)(void *), void *param) NOEXCEPT {
+		if(::getcontext(&(ctx.uc)) != 0){
+			const int err_code = errno;
+			LOG_POSEIDON_FATAL("::getcontext() failed: err_code = ", err_code);
+			std::abort();
+		}
+		ctx.uc.uc_stack.ss_sp = stack;
+		ctx.uc.uc_stack.ss_size = size;
+		ctx.uc.uc_link = NULLPTR;
+		ctx.proc = proc;
+		ctx.param = param;
+
+		int params[2] = { };
+		FiberContext *const ptr = &ctx;
+		BOOST_STATIC_ASSERT(sizeof(ptr) <= sizeof(params));
+		std::memcpy(params, &ptr, sizeof(ptr));
+		::makecontext(&(ctx.uc), reinterpret_cast<void (*)()>(&fiber_context_entry), 2, params[0], params[1]);
+	}
+	inline void switch_fiber_context(FiberContext &from, FiberContext &to) NOEXCEPT {
+		if(::swapcontext(&(from.uc), &(to.uc)) != 0){
+			const int err_code = errno;
+			LOG_POSEIDON_FATAL("::swapcontext() failed: err_code = ", err_code);
+			std::abort();
+		}
+	}
+#endif
+
 	struct FiberControl : NONCOPYABLE {
 		struct Initializer { };
 
+		boost::weak_ptr<const void> category;
 		RecursiveMutex queue_mutex;
 		std::deque<JobElement> queue;
 
 		FiberState state;
-		FiberStackAllocator::StoragePtr stack;
-		::ucontext_t inner;
-		::ucontext_t outer;
+		// 挂起的纤程只能在挂起它的线程中恢复，因为编译器可能会缓存线程局部变量的地址。
+		std::size_t owner;
+		// 只有挂起的纤程才拥有自己的栈，参见 schedule_fiber()。
+		FiberStackAllocator::StackPtr stack;
+		FiberContext inner;
+		FiberContext outer;
 
 		explicit FiberControl(Initializer){
 			state = FS_READY;
-			stack = g_stack_allocator.allocate();
+			owner = 0;
 #ifndef NDEBUG
 			std::memset(&inner, 0xCC, sizeof(outer));
 			std::memset(&outer, 0xCC, sizeof(outer));
@@ -133,7 +417,9 @@ namespace {
 		}
 		~FiberControl(){
 			assert(state == FS_READY);
-			g_stack_allocator.deallocate(STD_MOVE_IDN(stack));
+			if(stack){
+				g_stack_allocator.deallocate(STD_MOVE_IDN(stack));
+			}
 #ifndef NDEBUG
 			std::memset(&inner, 0xCC, sizeof(outer));
 			std::memset(&outer, 0xCC, sizeof(outer));
@@ -141,51 +427,114 @@ namespace {
 		}
 	};
 
+	// 每个工作线程拥有一个运行队列，空闲时从其他线程的运行队列尾部窃取纤程。
+	// 同一个纤程在任一时刻只属于一个运行队列、等待列表或者正在执行它的线程，因此同一类别的任务总是按顺序执行的。
+	struct WorkerControl : NONCOPYABLE {
+		Thread thread;
+
+		Mutex run_queue_mutex;
+		std::deque<FiberControl *> run_queue;
+
+		// 以下成员只由自身的线程访问。
+		// 挂起在这个线程中的纤程数量。
+		std::size_t pinned_count;
+		// 执行任务时使用的栈。任务没有挂起就执行完毕时，栈留给下一个任务继续使用。
+		FiberStackAllocator::StackPtr spare_stack;
+		std::size_t spare_stack_uses;
+
+		WorkerControl()
+			: pinned_count(0), spare_stack_uses(0)
+		{
+		}
+	};
+
+	enum WorkerMode {
+		WM_MODAL   = 0, // 主线程，quit_modal() 之后退出。
+		WM_THREAD  = 1, // 其他线程，quit_modal() 之后等到挂起的纤程全部完成再退出。
+	};
+
+	std::size_t g_thread_count = 1;
+
 	volatile bool g_running = false;
 
 	__thread FiberControl *volatile t_current_fiber = 0; // XXX: NULLPTR
+	__thread std::size_t t_current_worker_id = 0; // 工作线程下标加一，零表示不是工作线程。
+
+	// 只在 start() 和 stop() 中锁定 g_fiber_map_mutex 修改。工作线程只在这两者之间运行，因此工作线程访问时无需加锁。
+	std::vector<boost::shared_ptr<WorkerControl> > g_workers;
 
 	Mutex g_fiber_map_mutex;
 	ConditionVariable g_new_job;
 	boost::container::map<boost::weak_ptr<const void>, FiberControl> g_fiber_map;
+	// start() 之前投递的任务所在的纤程，在 start() 中放入运行队列。
+	std::vector<FiberControl *> g_early_fibers;
+	// stop() 之后投递的任务被丢弃。
+	bool g_stopped = false;
 
-	void fiber_proc(int low, int high) NOEXCEPT {
-		PROFILE_ME;
-
+	// 挂起等待 JobPromise 的纤程。JobPromise 被满足或者超时之后，纤程被放回运行队列。
+	struct WaitingFiberElement {
 		FiberControl *fiber;
-		const int params[2] = { low, high };
-		std::memcpy(&fiber, params, sizeof(fiber));
+		const JobPromise *promise;
+		boost::uint64_t expiry_time;
+		bool insignificant;
 
-		LOG_POSEIDON_TRACE("Entering fiber ", static_cast<void *>(fiber));
-		try {
-			fiber->queue.front().job->perform();
-		} catch(std::exception &e){
-			LOG_POSEIDON_WARNING("std::exception thrown: what = ", e.what());
-		} catch(...){
-			LOG_POSEIDON_WARNING("Unknown exception thrown");
+		WaitingFiberElement(FiberControl *fiber_, const JobPromise *promise_, boost::uint64_t expiry_time_, bool insignificant_)
+			: fiber(fiber_), promise(promise_), expiry_time(expiry_time_), insignificant(insignificant_)
+		{
 		}
-		LOG_POSEIDON_TRACE("Exited from fiber ", static_cast<void *>(fiber));
-
+	};
+	MULTI_INDEX_MAP(WaitingFiberMap, WaitingFiberElement,
+		UNIQUE_MEMBER_INDEX(fiber)
+		MULTI_MEMBER_INDEX(promise)
+		MULTI_MEMBER_INDEX(expiry_time)
+	)
+
+	// 以下对象受 g_fiber_map_mutex 保护。
+	WaitingFiberMap g_waiting_fibers;
+	std::size_t g_next_worker = 0;
+
+	// 运行队列中可以被窃取的纤程数量。
+	volatile std::size_t g_stealable_count = 0;
+	// 等待中的纤程最早的超时时间，用于避免无谓地加锁。
+	volatile boost::uint64_t g_earliest_expiry_time = (boost::uint64_t)-1;
+
+	void fiber_proc(void *param) NOEXCEPT {
+		const AUTO(fiber, static_cast<FiberControl *>(param));
+		{
+			PROFILE_ME;
+
+			LOG_POSEIDON_TRACE("Entering fiber ", static_cast<void *>(fiber));
+			try {
+				fiber->queue.front().job->perform();
+			} catch(std::exception &e){
+				LOG_POSEIDON_WARNING("std::exception thrown: what = ", e.what());
+			} catch(...){
+				LOG_POSEIDON_WARNING("Unknown exception thrown");
+			}
+			LOG_POSEIDON_TRACE("Exited from fiber ", static_cast<void *>(fiber));
+		}
+		// 纤程栈上不能再有需要析构的对象。下次调度时上下文会被重新初始化，因此这里不会返回。
 		fiber->state = FS_READY;
+		switch_fiber_context(fiber->inner, fiber->outer);
+		std::abort();
 	}
 
-	void schedule_fiber(FiberControl *fiber) NOEXCEPT {
+	void schedule_fiber(WorkerControl *worker, FiberControl *fiber) NOEXCEPT {
 		PROFILE_ME;
 
+		// 大部分任务不会挂起，因此新的任务总是在工作线程的栈上执行，第一次挂起时才把栈转交给纤程。
+		bool on_spare_stack = false;
 		if(fiber->state == FS_READY){
-			if(::getcontext(&(fiber->inner)) != 0){
-				const int err_code = errno;
-				LOG_POSEIDON_FATAL("::getcontext() failed: err_code = ", err_code);
-				std::abort();
+			if(!worker->spare_stack){
+				try {
+					worker->spare_stack = g_stack_allocator.allocate();
+				} catch(std::exception &e){
+					LOG_POSEIDON_FATAL("Failed to allocate fiber stack: what = ", e.what());
+					std::abort();
+				}
 			}
-			fiber->inner.uc_stack.ss_sp = fiber->stack.get();
-			fiber->inner.uc_stack.ss_size = sizeof(*(fiber->stack));
-			fiber->inner.uc_link = &(fiber->outer);
-
-			int params[2] = { };
-			BOOST_STATIC_ASSERT(sizeof(fiber) <= sizeof(params));
-			std::memcpy(params, &fiber, sizeof(fiber));
-			::makecontext(&(fiber->inner), reinterpret_cast<void (*)()>(&fiber_proc), 2, params[0], params[1]);
+			init_fiber_context(fiber->inner, worker->spare_stack->get_base(), worker->spare_stack->get_size(), &fiber_proc, fiber);
+			on_spare_stack = true;
 		}
 
 		t_current_fiber = fiber;
@@ -196,40 +545,61 @@ namespace {
 				std::abort();
 			}
 			fiber->state = FS_RUNNING;
-			if(::swapcontext(&(fiber->outer), &(fiber->inner)) != 0){
-				const int err_code = errno;
-				LOG_POSEIDON_FATAL("::swapcontext() failed: err_code = ", err_code);
-				std::abort();
-			}
+			switch_fiber_context(fiber->outer, fiber->inner);
 		}
 		Profiler::end_stack_switch(profiler_hook);
 		t_current_fiber = NULLPTR;
+
+		if(fiber->state == FS_YIELDED){
+			if(on_spare_stack){
+				assert(!fiber->stack);
+				fiber->stack = STD_MOVE(worker->spare_stack);
+			}
+		} else {
+			// 工作线程的栈很少被归还，因此定期统计其使用量。
+			if(on_spare_stack && (++(worker->spare_stack_uses) % 1024 == 0)){
+				g_stack_allocator.record_usage(*(worker->spare_stack));
+			}
+			if(fiber->stack){
+				if(!worker->spare_stack){
+					worker->spare_stack = STD_MOVE(fiber->stack);
+				} else {
+					g_stack_allocator.deallocate(STD_MOVE_IDN(fiber->stack));
+				}
+			}
+		}
 	}
 
-	bool pump_one_fiber(FiberControl *fiber) NOEXCEPT {
+	bool pump_one_fiber(WorkerControl *worker, FiberControl *fiber) NOEXCEPT {
 		PROFILE_ME;
 
 		const AUTO(now, get_fast_mono_clock());
 
 		JobElement *elem;
+		boost::shared_ptr<const JobPromise> promise;
 		{
 			const RecursiveMutex::UniqueLock queue_lock(fiber->queue_mutex);
 			if(fiber->queue.empty()){
 				return false;
 			}
 			elem = &(fiber->queue.front());
-			if(elem->promise && !elem->promise->is_satisfied()){
-				if((now < elem->expiry_time) && !(elem->insignificant && !atomic_load(g_running, ATOMIC_CONSUME))){
-					return false;
-				}
-				LOG_POSEIDON_WARNING("Job timed out");
+			promise = elem->promise;
+		}
+		// 不能在持有 queue_mutex 时锁定 JobPromise，参见 JobDispatcher::wake_fibers()。
+		if(promise && !promise->is_satisfied()){
+			if((now < elem->expiry_time) && !(elem->insignificant && !atomic_load(g_running, ATOMIC_CONSUME))){
+				return false;
 			}
+			LOG_POSEIDON_WARNING("Job timed out");
+		}
+		{
+			const RecursiveMutex::UniqueLock queue_lock(fiber->queue_mutex);
 			elem->promise.reset();
 		}
 		if((fiber->state == FS_READY) && elem->withdrawn && *(elem->withdrawn)){
 			LOG_POSEIDON_DEBUG("Job is withdrawn");
 		} else {
-			schedule_fiber(fiber);
+			schedule_fiber(worker, fiber);
 		}
 		if(fiber->state == FS_READY){
 			const RecursiveMutex::UniqueLock queue_lock(fiber->queue_mutex);
@@ -237,26 +607,200 @@ namespace {
 		}
 		return true;
 	}
-	bool pump_one_round() NOEXCEPT {
-		PROFILE_ME;
 
-		bool busy = false;
-		Mutex::UniqueLock lock(g_fiber_map_mutex);
-		AUTO(it, g_fiber_map.begin());
-		while(it != g_fiber_map.end()){
-			AUTO(fiber, &(it->second));
-			lock.unlock();
+	// 以下函数调用前必须锁定 g_fiber_map_mutex。
+	void push_runnable_fiber(std::size_t index, FiberControl *fiber){
+		const AUTO_REF(worker, g_workers.at(index));
+		{
+			const Mutex::UniqueLock lock(worker->run_queue_mutex);
+			worker->run_queue.push_back(fiber);
+		}
+		if(fiber->state == FS_READY){
+			atomic_add(g_stealable_count, 1, ATOMIC_RELAXED);
+			g_new_job.signal();
+		} else {
+			// 挂起的纤程只能由指定的线程恢复，必须确保其被唤醒。
+			g_new_job.broadcast();
+		}
+	}
+	void update_earliest_expiry_time() NOEXCEPT {
+		boost::uint64_t expiry_time = (boost::uint64_t)-1;
+		if(!g_waiting_fibers.empty()){
+			expiry_time = g_waiting_fibers.begin<2>()->expiry_time;
+		}
+		atomic_store(g_earliest_expiry_time, expiry_time, ATOMIC_RELAXED);
+	}
+	bool has_runnable_fiber(std::size_t index){
+		if(atomic_load(g_stealable_count, ATOMIC_RELAXED) != 0){
+			return true;
+		}
+		const AUTO_REF(worker, g_workers.at(index));
+		const Mutex::UniqueLock lock(worker->run_queue_mutex);
+		return !worker->run_queue.empty();
+	}
+	void wake_expired_fibers(boost::uint64_t now){
+		for(;;){
+			const AUTO(it, g_waiting_fibers.begin<2>());
+			if(it == g_waiting_fibers.end<2>()){
+				break;
+			}
+			if(now < it->expiry_time){
+				break;
+			}
+			const AUTO(fiber, it->fiber);
+			g_waiting_fibers.erase<2>(it);
+			push_runnable_fiber(fiber->owner, fiber);
+		}
+		update_earliest_expiry_time();
+	}
+	void wake_insignificant_fibers(){
+		AUTO(it, g_waiting_fibers.begin());
+		while(it != g_waiting_fibers.end()){
+			if(!it->insignificant){
+				++it;
+				continue;
+			}
+			const AUTO(fiber, it->fiber);
+			it = g_waiting_fibers.erase(it);
+			push_runnable_fiber(fiber->owner, fiber);
+		}
+		update_earliest_expiry_time();
+	}
+
+	// 纤程执行一步之后决定其去向。
+	void reschedule_fiber(std::size_t index, FiberControl *fiber){
+		boost::shared_ptr<const JobPromise> promise;
+		{
+			const Mutex::UniqueLock lock(g_fiber_map_mutex);
+			boost::uint64_t expiry_time = 0;
+			bool insignificant = false;
 			{
-				busy += pump_one_fiber(fiber);
+				const RecursiveMutex::UniqueLock queue_lock(fiber->queue_mutex);
+				if(fiber->queue.empty()){
+					assert(fiber->state == FS_READY);
+					g_fiber_map.erase(fiber->category);
+					return;
+				}
+				const AUTO_REF(elem, fiber->queue.front());
+				promise = elem.promise;
+				expiry_time = elem.expiry_time;
+				insignificant = elem.insignificant;
 			}
-			lock.lock();
-			if(fiber->queue.empty()){
-				it = g_fiber_map.erase(it);
+			if(!promise || (insignificant && !atomic_load(g_running, ATOMIC_CONSUME))){
+				push_runnable_fiber((fiber->state == FS_YIELDED) ? fiber->owner : index, fiber);
+				return;
+			}
+			assert(fiber->state == FS_YIELDED);
+			g_waiting_fibers.insert(WaitingFiberElement(fiber, promise.get(), expiry_time, insignificant));
+			update_earliest_expiry_time();
+		}
+		// 先放入等待列表再检查，这样无论 JobPromise 在何时被满足，纤程都会被唤醒。
+		if(promise->check_and_mark_waited()){
+			JobDispatcher::wake_fibers(promise.get());
+		}
+	}
+
+	// 优先从自己的运行队列头部取，否则从其他线程的运行队列尾部窃取。挂起的纤程不能被窃取。
+	FiberControl *pop_runnable_fiber(std::size_t index) NOEXCEPT {
+		{
+			const AUTO_REF(worker, g_workers.at(index));
+			const Mutex::UniqueLock lock(worker->run_queue_mutex);
+			if(!worker->run_queue.empty()){
+				const AUTO(fiber, worker->run_queue.front());
+				worker->run_queue.pop_front();
+				if(fiber->state == FS_READY){
+					atomic_sub(g_stealable_count, 1, ATOMIC_RELAXED);
+				}
+				return fiber;
+			}
+		}
+		for(std::size_t i = 1; i < g_workers.size(); ++i){
+			const AUTO_REF(victim, g_workers.at((index + i) % g_workers.size()));
+			const Mutex::UniqueLock lock(victim->run_queue_mutex);
+			AUTO(it, victim->run_queue.end());
+			while(it != victim->run_queue.begin()){
+				--it;
+				const AUTO(fiber, *it);
+				if(fiber->state != FS_READY){
+					continue;
+				}
+				victim->run_queue.erase(it);
+				atomic_sub(g_stealable_count, 1, ATOMIC_RELAXED);
+				return fiber;
+			}
+		}
+		return NULLPTR;
+	}
+
+	bool pump_next_fiber(std::size_t index){
+		PROFILE_ME;
+
+		const AUTO(now, get_fast_mono_clock());
+		if(atomic_load(g_earliest_expiry_time, ATOMIC_RELAXED) <= now){
+			const Mutex::UniqueLock lock(g_fiber_map_mutex);
+			wake_expired_fibers(now);
+		}
+
+		const AUTO(fiber, pop_runnable_fiber(index));
+		if(!fiber){
+			return false;
+		}
+		const AUTO(worker, g_workers.at(index).get());
+		const bool was_yielded = (fiber->state == FS_YIELDED);
+		pump_one_fiber(worker, fiber);
+		const bool is_yielded = (fiber->state == FS_YIELDED);
+		if(!was_yielded && is_yielded){
+			fiber->owner = index;
+			++(worker->pinned_count);
+		} else if(was_yielded && !is_yielded){
+			--(worker->pinned_count);
+		}
+
+		reschedule_fiber(index, fiber);
+		return true;
+	}
+
+	void worker_loop(std::size_t index, WorkerMode mode){
+		PROFILE_ME;
+
+		const AUTO(worker, g_workers.at(index).get());
+		t_current_worker_id = index + 1;
+
+		for(;;){
+			bool busy;
+			do {
+				busy = pump_next_fiber(index);
+			} while(busy);
+
+			Mutex::UniqueLock lock(g_fiber_map_mutex);
+			const AUTO(now, get_fast_mono_clock());
+			wake_expired_fibers(now);
+			if(has_runnable_fiber(index)){
+				continue;
+			}
+			if(!atomic_load(g_running, ATOMIC_CONSUME)){
+				if((mode == WM_MODAL) || (worker->pinned_count == 0)){
+					break;
+				}
+			}
+			// 纤程被放入运行队列时会唤醒这里，因此只需要睡眠到最早的超时时间。
+			if(g_waiting_fibers.empty()){
+				g_new_job.wait(lock);
 			} else {
-				++it;
+				g_new_job.timed_wait(lock, g_waiting_fibers.begin<2>()->expiry_time - now);
 			}
 		}
-		return busy;
+
+		t_current_worker_id = 0;
+	}
+
+	void worker_thread_proc(std::size_t index){
+		PROFILE_ME;
+		LOG_POSEIDON_INFO("Job worker ", index, " started.");
+
+		worker_loop(index, WM_THREAD);
+
+		LOG_POSEIDON_INFO("Job worker ", index, " stopped.");
 	}
 }
 
@@ -265,6 +809,32 @@ void JobDispatcher::start(){
 
 	MainConfig::get(g_job_timeout, "job_timeout");
 	LOG_POSEIDON_DEBUG("Job timeout = ", g_job_timeout);
+
+	MainConfig::get(g_thread_count, "job_thread_count");
+	LOG_POSEIDON_DEBUG("Job thread count = ", g_thread_count);
+
+	std::size_t stack_size = 256 * 1024;
+	MainConfig::get(stack_size, "fiber_stack_size");
+	std::size_t stack_pool_size = 64;
+	MainConfig::get(stack_pool_size, "fiber_stack_pool_size");
+	g_stack_allocator.reset(stack_size, stack_pool_size);
+	LOG_POSEIDON_DEBUG("Fiber stack size = ", g_stack_allocator.get_stack_size(), ", pool size = ", stack_pool_size);
+
+	const AUTO(thread_count, std::max<std::size_t>(g_thread_count, 1));
+	std::vector<boost::shared_ptr<WorkerControl> > workers;
+	workers.reserve(thread_count);
+	for(std::size_t i = 0; i < thread_count; ++i){
+		workers.push_back(boost::make_shared<WorkerControl>());
+	}
+
+	const Mutex::UniqueLock lock(g_fiber_map_mutex);
+	g_workers.swap(workers);
+	g_stopped = false;
+	for(std::size_t i = 0; i < g_early_fibers.size(); ++i){
+		push_runnable_fiber(i % g_workers.size(), g_early_fibers.at(i));
+	}
+	LOG_POSEIDON_DEBUG("Jobs enqueued before start: fibers = ", g_early_fibers.size());
+	g_early_fibers.clear();
 }
 void JobDispatcher::stop(){
 	LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO, "Stopping job dispatcher...");
@@ -273,8 +843,15 @@ void JobDispatcher::stop(){
 	for(;;){
 		std::size_t pending_fibers;
 		{
-			const Mutex::UniqueLock lock(g_fiber_map_mutex);
+			Mutex::UniqueLock lock(g_fiber_map_mutex);
 			pending_fibers = g_fiber_map.size();
+			if(pending_fibers != 0){
+				const AUTO(now, get_fast_mono_clock());
+				wake_expired_fibers(now);
+				if(!has_runnable_fiber(0) && !g_waiting_fibers.empty()){
+					g_new_job.timed_wait(lock, g_waiting_fibers.begin<2>()->expiry_time - now);
+				}
+			}
 		}
 		if(pending_fibers == 0){
 			break;
@@ -286,8 +863,21 @@ void JobDispatcher::stop(){
 			last_info_time = now;
 		}
 
-		pump_one_round();
+		// 其他工作线程都已退出，剩余的纤程都在主线程中执行。
+		pump_next_fiber(0);
+	}
+
+	for(std::size_t i = 0; i < g_workers.size(); ++i){
+		AUTO_REF(spare_stack, g_workers.at(i)->spare_stack);
+		if(spare_stack){
+			g_stack_allocator.deallocate(STD_MOVE_IDN(spare_stack));
+		}
 	}
+	LOG_POSEIDON_INFO("Fiber stack high-water mark = ", g_stack_allocator.get_high_water(), " of ", g_stack_allocator.get_stack_size(), " bytes");
+
+	const Mutex::UniqueLock lock(g_fiber_map_mutex);
+	g_workers.clear();
+	g_stopped = true;
 }
 
 void JobDispatcher::do_modal(){
@@ -298,19 +888,17 @@ void JobDispatcher::do_modal(){
 		std::abort();
 	}
 
-	unsigned timeout = 0;
-	for(;;){
-		bool busy;
-		do {
-			busy = pump_one_round();
-			timeout = std::min(timeout * 2u + 1u, !busy * 100u);
-		} while(busy);
-
-		Mutex::UniqueLock lock(g_fiber_map_mutex);
-		if(!atomic_load(g_running, ATOMIC_CONSUME)){
-			break;
+	for(std::size_t i = 1; i < g_workers.size(); ++i){
+		Thread(boost::bind(&worker_thread_proc, i), "J   ").swap(g_workers.at(i)->thread);
+	}
+
+	worker_loop(0, WM_MODAL);
+
+	for(std::size_t i = 1; i < g_workers.size(); ++i){
+		Thread &thread = g_workers.at(i)->thread;
+		if(thread.joinable()){
+			thread.join();
 		}
-		g_new_job.timed_wait(lock, timeout);
 	}
 }
 bool JobDispatcher::is_running(){
@@ -318,7 +906,25 @@ bool JobDispatcher::is_running(){
 }
 void JobDispatcher::quit_modal(){
 	atomic_store(g_running, false, ATOMIC_RELEASE);
-	g_new_job.signal();
+
+	const Mutex::UniqueLock lock(g_fiber_map_mutex);
+	wake_insignificant_fibers();
+	g_new_job.broadcast();
+}
+
+void JobDispatcher::wake_fibers(const JobPromise *promise){
+	PROFILE_ME;
+
+	const Mutex::UniqueLock lock(g_fiber_map_mutex);
+	const AUTO(range, g_waiting_fibers.equal_range<1>(promise));
+	if(range.first == range.second){
+		return;
+	}
+	for(AUTO(it, range.first); it != range.second; ++it){
+		push_runnable_fiber(it->fiber->owner, it->fiber);
+	}
+	g_waiting_fibers.erase<1>(range.first, range.second);
+	update_earliest_expiry_time();
 }
 
 void JobDispatcher::enqueue(boost::shared_ptr<JobBase> job, boost::shared_ptr<const bool> withdrawn){
@@ -331,16 +937,43 @@ void JobDispatcher::enqueue(boost::shared_ptr<JobBase> job, boost::shared_ptr<co
 	}
 
 	const Mutex::UniqueLock lock(g_fiber_map_mutex);
+	if(g_stopped){
+		LOG_POSEIDON_DEBUG("Job dispatcher has stopped, discarding job.");
+		return;
+	}
 	AUTO(it, g_fiber_map.find(category));
-	if(it == g_fiber_map.end()){
+	if((it == g_fiber_map.end()) && g_workers.empty()){
+		// 还没有工作线程，等到 start() 时再放入运行队列。
 		it = g_fiber_map.emplace(category, FiberControl::Initializer()).first;
-	}
-	const AUTO(fiber, &(it->second));
-	{
+		const AUTO(fiber, &(it->second));
+		fiber->category = category;
+		{
+			const RecursiveMutex::UniqueLock queue_lock(fiber->queue_mutex);
+			fiber->queue.push_back(JobElement(STD_MOVE(job), STD_MOVE(withdrawn)));
+		}
+		g_early_fibers.push_back(fiber);
+	} else if(it == g_fiber_map.end()){
+		// 新的纤程放入当前工作线程的运行队列，否则轮流分配。
+		std::size_t index;
+		if(t_current_worker_id != 0){
+			index = t_current_worker_id - 1;
+		} else {
+			index = g_next_worker++ % g_workers.size();
+		}
+		it = g_fiber_map.emplace(category, FiberControl::Initializer()).first;
+		const AUTO(fiber, &(it->second));
+		fiber->category = category;
+		{
+			const RecursiveMutex::UniqueLock queue_lock(fiber->queue_mutex);
+			fiber->queue.push_back(JobElement(STD_MOVE(job), STD_MOVE(withdrawn)));
+		}
+		push_runnable_fiber(index, fiber);
+	} else {
+		// 已有的纤程必然在某个运行队列、等待列表中，或者正在执行。
+		const AUTO(fiber, &(it->second));
 		const RecursiveMutex::UniqueLock queue_lock(fiber->queue_mutex);
 		fiber->queue.push_back(JobElement(STD_MOVE(job), STD_MOVE(withdrawn)));
 	}
-	g_new_job.signal();
 }
 void JobDispatcher::yield(const boost::shared_ptr<const JobPromise> &promise, bool insignificant){
 	PROFILE_ME;
@@ -365,11 +998,7 @@ void JobDispatcher::yield(const boost::shared_ptr<const JobPromise> &promise, bo
 		const AUTO(profiler_hook, Profiler::begin_stack_switch());
 		{
 			fiber->state = FS_YIELDED;
-			if(::swapcontext(&(fiber->inner), &(fiber->outer)) != 0){
-				const int err_code = errno;
-				LOG_POSEIDON_FATAL("::swapcontext() failed: err_code = ", err_code);
-				std::abort();
-			}
+			switch_fiber_context(fiber->inner, fiber->outer);
 		}
 		Profiler::end_stack_switch(profiler_hook);
 		LOG_POSEIDON_TRACE("Resumed to fiber ", static_cast<void *>(fiber));
@@ -27,6 +27,8 @@ public:
 
 	static void enqueue(boost::shared_ptr<JobBase> job, boost::shared_ptr<const bool> withdrawn);
 	static void yield(const boost::shared_ptr<const JobPromise> &promise, bool insignificant);
+	// 由 JobPromise 在被满足时调用，把等待它的纤程放回运行队列。
+	static void wake_fibers(const JobPromise *promise);
 };
 
 }
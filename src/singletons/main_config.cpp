@@ -6,6 +6,8 @@
 #include "../config_file.hpp"
 #include "../log.hpp"
 #include "../system_exception.hpp"
+#include "../atomic.hpp"
+#include "../mutex.hpp"
 
 namespace Poseidon {
 
@@ -14,6 +16,11 @@ namespace {
 
 	ConfigFile g_config;
 
+	// 旧的快照可能仍在被其他线程读取，因此不释放。重新加载很少发生。
+	Mutex g_snapshot_mutex;
+	std::vector<boost::shared_ptr<const MainConfig::Snapshot> > g_snapshots;
+	const MainConfig::Snapshot *volatile g_snapshot = NULLPTR;
+
 	std::string get_real_path(const char *path){
 		std::string ret;
 		char *real_path = NULLPTR;
@@ -41,13 +48,49 @@ void MainConfig::set_run_path(const char *path){
 	}
 }
 
+MainConfig::Snapshot::Snapshot(const ConfigFile &config){
+	config.get(tcp_request_timeout, "tcp_request_timeout", 5000);
+	config.get(tcp_response_timeout, "tcp_response_timeout", 30000);
+
+	config.get(cbpp_max_request_length, "cbpp_max_request_length", 16384);
+	config.get(cbpp_keep_alive_timeout, "cbpp_keep_alive_timeout", 30000);
+
+	config.get(http_max_headers_per_request, "http_max_headers_per_request", 64);
+	config.get(http_max_header_line_length, "http_max_header_line_length", 8192);
+	config.get(http_max_request_length, "http_max_request_length", 16384);
+	if(http_max_request_length < 1){
+		http_max_request_length = 1;
+	}
+	config.get(http_keep_alive_timeout, "http_keep_alive_timeout", 5000);
+	config.get(http_digest_nonce_expiry_time, "http_digest_nonce_expiry_time", 60000);
+
+	config.get(websocket_max_request_length, "websocket_max_request_length", 16384);
+	config.get(websocket_keep_alive_timeout, "websocket_keep_alive_timeout", 30000);
+}
+
 void MainConfig::reload(){
 
 	LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO, "Loading main config file: ", g_main_conf);
-	g_config = ConfigFile(g_main_conf);
+	ConfigFile config(g_main_conf);
+	// 先解析快照，出错时不影响当前配置。
+	const AUTO(snapshot, boost::make_shared<const Snapshot>(config));
+
+	const Mutex::UniqueLock lock(g_snapshot_mutex);
+	g_snapshots.push_back(snapshot);
+	g_config.swap(config);
+	atomic_store(g_snapshot, snapshot.get(), ATOMIC_RELEASE);
 }
 const ConfigFile &MainConfig::get_config(){
 	return g_config;
 }
+const MainConfig::Snapshot &MainConfig::get_snapshot() NOEXCEPT {
+	const AUTO(snapshot, atomic_load(g_snapshot, ATOMIC_CONSUME));
+	if(!snapshot){
+		// 加载之前使用默认值。
+		static const Snapshot s_default((ConfigFile()));
+		return s_default;
+	}
+	return *snapshot;
+}
 
 }
@@ -5,10 +5,33 @@
 #define POSEIDON_SINGLETONS_MAIN_CONFIG_HPP_
 
 #include "../config_file.hpp"
+#include <boost/cstdint.hpp>
 
 namespace Poseidon {
 
 class MainConfig {
+public:
+	// 热路径上使用的配置项，在加载时解析好。
+	// 重新加载时整体替换，同一个快照中的值总是一致的。
+	struct Snapshot {
+		boost::uint64_t tcp_request_timeout;
+		boost::uint64_t tcp_response_timeout;
+
+		boost::uint64_t cbpp_max_request_length;
+		boost::uint64_t cbpp_keep_alive_timeout;
+
+		std::size_t http_max_headers_per_request;
+		std::size_t http_max_header_line_length;
+		boost::uint64_t http_max_request_length;
+		boost::uint64_t http_keep_alive_timeout;
+		boost::uint64_t http_digest_nonce_expiry_time;
+
+		boost::uint64_t websocket_max_request_length;
+		boost::uint64_t websocket_keep_alive_timeout;
+
+		explicit Snapshot(const ConfigFile &config);
+	};
+
 private:
 	MainConfig();
 
@@ -17,6 +40,8 @@ public:
 
 	static void reload();
 	static const ConfigFile &get_config();
+	// 返回的引用在进程退出前一直有效。
+	static const Snapshot &get_snapshot() NOEXCEPT;
 
 	template<typename T>
 	static bool get(T &val, const char *key){
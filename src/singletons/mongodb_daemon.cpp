@@ -587,7 +587,6 @@ namespace {
 
 			boost::shared_ptr<MongoDb::Connection> master_conn, slave_conn;
 
-			unsigned timeout = 0;
 			for(;;){
 				bool busy;
 				do {
@@ -622,14 +621,22 @@ namespace {
 						}
 					}
 					busy = pump_one_operation(master_conn, slave_conn);
-					timeout = std::min<unsigned>(timeout * 2u + 1u, !busy * 100u);
 				} while(busy);
 
 				Mutex::UniqueLock lock(m_mutex);
 				if(!atomic_load(m_running, ATOMIC_CONSUME)){
 					break;
 				}
-				m_new_operation.timed_wait(lock, timeout);
+				// 必须在锁内重新检查队列，否则在此之前投递的操作的通知会丢失。
+				if(m_queue.empty()){
+					m_new_operation.wait(lock);
+				} else if(!atomic_load(m_urgent, ATOMIC_CONSUME)){
+					const AUTO(now, get_fast_mono_clock());
+					const AUTO(due_time, m_queue.front().due_time);
+					if(now < due_time){
+						m_new_operation.timed_wait(lock, due_time - now);
+					}
+				}
 			}
 
 			LOG_POSEIDON_INFO("MongoDB thread stopped.");
@@ -642,7 +649,9 @@ namespace {
 			atomic_store(m_running, true, ATOMIC_RELEASE);
 		}
 		void stop(){
+			const Mutex::UniqueLock lock(m_mutex);
 			atomic_store(m_running, false, ATOMIC_RELEASE);
+			m_new_operation.signal();
 		}
 		void safe_join(){
 			wait_till_idle();
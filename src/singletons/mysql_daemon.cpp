@@ -5,6 +5,7 @@
 #include "mysql_daemon.hpp"
 #include "main_config.hpp"
 #include <boost/container/flat_map.hpp>
+#include <boost/container/flat_set.hpp>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -27,6 +28,8 @@
 #include "../time.hpp"
 #include "../errno.hpp"
 #include "../buffer_streams.hpp"
+#include "../crc32.hpp"
+#include "../multi_index_map.hpp"
 
 namespace Poseidon {
 
@@ -45,10 +48,15 @@ namespace {
 
 	std::string     g_dump_dir          = VAL_INIT;
 	boost::uint64_t g_save_delay        = 5000;
+	boost::uint64_t g_save_delay_min    = 500;
+	std::size_t     g_max_queue_length  = 100000;
+	std::size_t     g_cache_max_objects = 0;
 	boost::uint64_t g_reconn_delay      = 10000;
 	std::size_t     g_max_retry_count   = 3;
 	boost::uint64_t g_retry_init_delay  = 1000;
 	std::size_t     g_max_thread_count  = 8;
+	std::size_t     g_batch_max_size    = 1048576;
+	bool            g_use_prepared      = true;
 
 
 	inline boost::shared_ptr<MySql::Connection> real_create_connection(bool from_slave){
@@ -120,6 +128,49 @@ namespace {
 		LOG_POSEIDON_ERROR("Error writing SQL dump: what = ", e.what());
 	}
 
+	// 各表的主键列，用于只写入修改过的字段。
+	Mutex g_primary_key_mutex;
+	boost::container::flat_map<SharedNts, std::vector<std::string> > g_primary_keys;
+
+	void get_primary_key(std::vector<std::string> &keys, const boost::shared_ptr<MySql::Connection> &conn, const char *table){
+		PROFILE_ME;
+
+		{
+			const Mutex::UniqueLock lock(g_primary_key_mutex);
+			const AUTO(it, g_primary_keys.find(SharedNts::view(table)));
+			if(it != g_primary_keys.end()){
+				keys = it->second;
+				return;
+			}
+		}
+
+		std::string query;
+		query += "SHOW KEYS FROM `";
+		query += table;
+		query += "` WHERE `Key_name` = 'PRIMARY'";
+		LOG_POSEIDON_DEBUG("Querying primary key: table = ", table);
+		boost::container::flat_map<boost::uint64_t, std::string> columns;
+		try {
+			conn->execute_sql(query);
+			while(conn->fetch_row()){
+				columns[conn->get_unsigned("Seq_in_index")] = conn->get_string("Column_name");
+			}
+		} catch(...){
+			conn->discard_result();
+			throw;
+		}
+		conn->discard_result();
+		keys.clear();
+		keys.reserve(columns.size());
+		for(AUTO(it, columns.begin()); it != columns.end(); ++it){
+			keys.push_back(it->second);
+		}
+		LOG_POSEIDON_DEBUG("Primary key of table ", table, ": columns = ", keys.size());
+
+		const Mutex::UniqueLock lock(g_primary_key_mutex);
+		g_primary_keys[SharedNts(table)] = keys;
+	}
+
 	// 数据库线程操作。
 	class OperationBase : NONCOPYABLE {
 	private:
@@ -145,6 +196,10 @@ namespace {
 		virtual const char *get_table() const = 0;
 		virtual void generate_sql(std::string &query) const = 0;
 		virtual void execute(const boost::shared_ptr<MySql::Connection> &conn, const std::string &query) const = 0;
+		// 返回 false 表示不支持预处理语句，此时使用 generate_sql() 和 execute()。
+		virtual bool execute_prepared(const boost::shared_ptr<MySql::Connection> & /* conn */) const {
+			return false;
+		}
 
 		virtual bool is_isolated() const {
 			if(!m_promise){
@@ -183,15 +238,143 @@ namespace {
 	private:
 		const boost::shared_ptr<const MySql::ObjectBase> m_object;
 		const bool m_to_replace;
+		const boost::uint64_t m_serial;
+
+		// 以下只由数据库线程访问。执行时取出对象的修改标记，重试时沿用。
+		mutable bool m_dirty_taken;
+		mutable bool m_covered; // 对应的修改已经由之前的写入取出，无需再写。
+		mutable std::vector<bool> m_dirty_fields;
+		mutable std::vector<std::size_t> m_key_indices;
 
 	public:
 		SaveOperation(boost::shared_ptr<JobPromise> promise,
 			boost::shared_ptr<const MySql::ObjectBase> object, bool to_replace)
 			: OperationBase(STD_MOVE(promise))
-			, m_object(STD_MOVE(object)), m_to_replace(to_replace)
+			, m_object(STD_MOVE(object)), m_to_replace(to_replace), m_serial(m_object->next_save_serial())
+			, m_dirty_taken(false), m_covered(false)
 		{
 		}
 
+	private:
+		// 如果可以只 UPDATE 修改过的字段，返回 true，并把主键字段的下标存入 m_key_indices。
+		// 主键字段被修改过，或者修改了所有字段时，仍然写入整行。
+		bool plan_partial_update(const boost::shared_ptr<MySql::Connection> &conn) const {
+			if(!m_to_replace){
+				return false;
+			}
+			if(!m_dirty_taken){
+				bool covered;
+				if(!m_object->take_dirty_fields(m_dirty_fields, m_serial, &covered)){
+					m_dirty_fields.clear();
+					// 每次修改字段都会创建一个写入操作。之前的写入已经取出了这次的修改，这里什么都不用做。
+					m_covered = covered;
+				}
+				m_dirty_taken = true;
+			}
+			if(m_covered){
+				return false;
+			}
+			const AUTO(dirty_count, static_cast<std::size_t>(std::count(m_dirty_fields.begin(), m_dirty_fields.end(), true)));
+			if((dirty_count == 0) || (dirty_count == m_dirty_fields.size())){
+				return false;
+			}
+			std::vector<std::string> keys;
+			try {
+				get_primary_key(keys, conn, get_table());
+			} catch(std::exception &e){
+				LOG_POSEIDON_WARNING("Could not get primary key: table = ", get_table(), ", what = ", e.what());
+				return false;
+			}
+			if(keys.empty()){
+				return false;
+			}
+			m_key_indices.clear();
+			for(AUTO(it, keys.begin()); it != keys.end(); ++it){
+				std::size_t index = 0;
+				while((index < m_dirty_fields.size()) && (std::strcmp(m_object->get_field_name(index), it->c_str()) != 0)){
+					++index;
+				}
+				if((index == m_dirty_fields.size()) || m_dirty_fields.at(index)){
+					return false;
+				}
+				m_key_indices.push_back(index);
+			}
+			return true;
+		}
+		// 返回 false 表示没有匹配的行，需要写入整行。
+		bool execute_partial_update(const boost::shared_ptr<MySql::Connection> &conn, bool prepared) const {
+			PROFILE_ME;
+
+			Buffer_ostream os;
+			MySql::StatementParams params;
+			os <<"UPDATE `" <<get_table() <<"` SET ";
+			bool first = true;
+			for(std::size_t index = 0; index < m_dirty_fields.size(); ++index){
+				if(!m_dirty_fields.at(index)){
+					continue;
+				}
+				if(!first){
+					os <<", ";
+				}
+				first = false;
+				os <<"`" <<m_object->get_field_name(index) <<"` = ";
+				if(prepared){
+					os <<"?";
+					m_object->bind_sql_field_param(params, index);
+				} else {
+					m_object->generate_sql_field_value(os, index);
+				}
+			}
+			os <<" WHERE ";
+			for(AUTO(it, m_key_indices.begin()); it != m_key_indices.end(); ++it){
+				if(it != m_key_indices.begin()){
+					os <<" AND ";
+				}
+				os <<"`" <<m_object->get_field_name(*it) <<"` = ";
+				if(prepared){
+					os <<"?";
+					m_object->bind_sql_field_param(params, *it);
+				} else {
+					m_object->generate_sql_field_value(os, *it);
+				}
+			}
+			const AUTO(query, os.get_buffer().dump_string());
+			LOG_POSEIDON_DEBUG("Executing partial update: table = ", get_table(), ", query = ", query);
+			if(prepared){
+				conn->execute_prepared(query, params);
+			} else {
+				conn->execute_sql(query);
+			}
+			const AUTO(affected_rows, conn->get_affected_rows());
+			conn->discard_result();
+			if(affected_rows == 0){
+				LOG_POSEIDON_DEBUG("No rows matched, writing the whole row: table = ", get_table());
+				return false;
+			}
+			return true;
+		}
+
+	public:
+		const boost::shared_ptr<const MySql::ObjectBase> &get_object() const {
+			return m_object;
+		}
+		bool is_to_replace() const {
+			return m_to_replace;
+		}
+		// 放弃这次写入时调用，把取出的修改标记还给对象。
+		void restore_dirty_fields() const NOEXCEPT {
+			if(!m_dirty_taken || m_covered){
+				return;
+			}
+			try {
+				m_object->restore_dirty_fields(m_dirty_fields);
+			} catch(std::exception &e){
+				LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
+			}
+			m_dirty_fields.clear();
+			m_dirty_taken = false;
+		}
+
 	protected:
 		bool should_use_slave() const {
 			return false;
@@ -216,8 +399,48 @@ namespace {
 		void execute(const boost::shared_ptr<MySql::Connection> &conn, const std::string &query) const OVERRIDE {
 			PROFILE_ME;
 
+			if(plan_partial_update(conn) && execute_partial_update(conn, false)){
+				return;
+			}
+			if(m_covered){
+				LOG_POSEIDON_TRACE("Changes have been written by a previous save: table = ", get_table());
+				return;
+			}
 			conn->execute_sql(query);
 		}
+		bool execute_prepared(const boost::shared_ptr<MySql::Connection> &conn) const OVERRIDE {
+			PROFILE_ME;
+
+			if(!g_use_prepared){
+				return false;
+			}
+			if(plan_partial_update(conn) && execute_partial_update(conn, true)){
+				return true;
+			}
+			if(m_covered){
+				LOG_POSEIDON_TRACE("Changes have been written by a previous save: table = ", get_table());
+				return true;
+			}
+			const char *const table = get_table();
+			const char *const placeholders = m_object->get_sql_placeholders();
+			std::string sql;
+			sql.reserve(32 + std::strlen(table) + std::strlen(placeholders));
+			if(m_to_replace){
+				sql += "REPLACE";
+			} else {
+				sql += "INSERT";
+			}
+			sql += " INTO `";
+			sql += table;
+			sql += "` SET ";
+			sql += placeholders;
+
+			MySql::StatementParams params;
+			m_object->bind_sql_params(params);
+			LOG_POSEIDON_DEBUG("Executing prepared SQL: table = ", table, ", query = ", sql);
+			conn->execute_prepared(sql, params);
+			return true;
+		}
 	};
 
 	class LoadOperation : public OperationBase {
@@ -428,15 +651,163 @@ namespace {
 		}
 	};
 
+	// 分片表上不按键路由的操作需要与该表所有分片上的写入保持顺序。
+	// 这样的操作被投递到每个分片所在的线程中，最后到达的线程执行它，其余线程等待它完成。
+	class ShardBarrier : NONCOPYABLE {
+	private:
+		mutable Mutex m_mutex;
+		mutable ConditionVariable m_cond;
+		std::size_t m_pending;
+		bool m_cancelled;
+		bool m_done;
+
+	public:
+		explicit ShardBarrier(std::size_t count)
+			: m_pending(count), m_cancelled(false), m_done(false)
+		{
+		}
+
+	public:
+		// 返回 true 表示这是最后一个到达的线程。已经取消的屏障没有最后一个线程。
+		bool arrive(){
+			const Mutex::UniqueLock lock(m_mutex);
+			assert(m_pending != 0);
+			if(--m_pending != 0){
+				return false;
+			}
+			if(m_cancelled){
+				m_done = true;
+				m_cond.broadcast();
+				return false;
+			}
+			return true;
+		}
+		// 部分线程没有投递成功时调用，不再等待它们，也不再执行操作。
+		void cancel(std::size_t missing) NOEXCEPT {
+			const Mutex::UniqueLock lock(m_mutex);
+			assert(m_pending >= missing);
+			m_cancelled = true;
+			m_pending -= missing;
+			if(m_pending == 0){
+				m_done = true;
+				m_cond.broadcast();
+			}
+		}
+		void wait(){
+			Mutex::UniqueLock lock(m_mutex);
+			while(!m_done){
+				m_cond.wait(lock);
+			}
+		}
+		void finish() NOEXCEPT {
+			const Mutex::UniqueLock lock(m_mutex);
+			m_done = true;
+			m_cond.broadcast();
+		}
+	};
+
+	class BarrierOperation : public OperationBase {
+	private:
+		const boost::shared_ptr<OperationBase> m_operation;
+		const boost::shared_ptr<ShardBarrier> m_barrier;
+		std::vector<boost::shared_ptr<const void> > m_probes;
+
+		// 以下只由数据库线程访问。
+		mutable bool m_arrived;
+		mutable bool m_last;
+
+	public:
+		BarrierOperation(boost::shared_ptr<OperationBase> operation, boost::shared_ptr<ShardBarrier> barrier)
+			: OperationBase(VAL_INIT)
+			, m_operation(STD_MOVE(operation)), m_barrier(STD_MOVE(barrier))
+			, m_arrived(false), m_last(false)
+		{
+		}
+		~BarrierOperation(){
+			if(m_last){
+				m_barrier->finish();
+			}
+		}
+
+	public:
+		void add_probe(boost::shared_ptr<const void> probe){
+			m_probes.push_back(STD_MOVE(probe));
+		}
+
+	protected:
+		bool should_use_slave() const {
+			return m_operation->should_use_slave();
+		}
+		boost::shared_ptr<const MySql::ObjectBase> get_combinable_object() const OVERRIDE {
+			return VAL_INIT; // 不能合并。
+		}
+		const char *get_table() const OVERRIDE {
+			return m_operation->get_table();
+		}
+		void generate_sql(std::string &query) const OVERRIDE {
+			m_operation->generate_sql(query);
+		}
+		void execute(const boost::shared_ptr<MySql::Connection> &conn, const std::string &query) const OVERRIDE {
+			m_operation->execute(conn, query);
+		}
+		bool execute_prepared(const boost::shared_ptr<MySql::Connection> &conn) const OVERRIDE {
+			if(!m_arrived){
+				m_last = m_barrier->arrive();
+				m_arrived = true;
+			}
+			if(!m_last){
+				LOG_POSEIDON_DEBUG("Waiting for other shards: table = ", get_table());
+				m_barrier->wait();
+				return true;
+			}
+			return m_operation->execute_prepared(conn);
+		}
+
+		bool is_isolated() const OVERRIDE {
+			if(!m_last){
+				return false;
+			}
+			return m_operation->is_isolated();
+		}
+		bool is_satisfied() const OVERRIDE {
+			if(!m_last){
+				return true;
+			}
+			return m_operation->is_satisfied();
+		}
+		void set_success() OVERRIDE {
+			if(!m_last){
+				return;
+			}
+			m_operation->set_success();
+		}
+		void set_exception(
+#ifdef POSEIDON_CXX11
+			std::exception_ptr ep
+#else
+			boost::exception_ptr ep
+#endif
+			) OVERRIDE
+		{
+			if(!m_last){
+				return;
+			}
+			m_operation->set_exception(STD_MOVE(ep));
+		}
+	};
+
 	class MySqlThread : NONCOPYABLE {
 	private:
 		struct OperationQueueElement {
 			boost::shared_ptr<OperationBase> operation;
 			boost::uint64_t due_time;
 			std::size_t retry_count;
+			bool batched;     // 已经随合并写入完成，出队即可。
+			bool unbatchable; // 合并写入失败过，逐个执行以保留重试和转储。
 
 			OperationQueueElement(boost::shared_ptr<OperationBase> operation_, boost::uint64_t due_time_)
 				: operation(STD_MOVE(operation_)), due_time(due_time_), retry_count(0)
+				, batched(false), unbatchable(false)
 			{
 			}
 		};
@@ -450,14 +821,224 @@ namespace {
 		volatile bool m_urgent; // 无视延迟写入，一次性处理队列中所有操作。
 		boost::container::deque<OperationQueueElement> m_queue;
 
+		boost::uint64_t m_save_delay; // 当前的写入延迟，在 g_save_delay_min 和 g_save_delay 之间调整。
+		boost::shared_ptr<JobPromise> m_queue_space; // 队列超过上限时创建，降下来之后满足。
+
+		std::size_t m_max_packet_size; // 只由本线程访问。
+		double m_avg_latency; // 只由本线程访问。每个操作执行时间的滑动平均，单位毫秒。
+
 	public:
 		MySqlThread()
 			: m_running(false)
 			, m_urgent(false)
+			, m_save_delay(g_save_delay)
+			, m_max_packet_size(0), m_avg_latency(0)
 		{
 		}
 
 	private:
+		// 必须在 m_mutex 锁定的情况下调用。
+		// 积压的操作按当前的速度无法在延迟内完成，或者没有可以合并的写入时，缩短延迟；
+		// 数据库处理得过来时延长延迟，以合并更多写入。
+		void update_save_delay(double latency){
+			m_avg_latency += (latency - m_avg_latency) / 8;
+
+			const AUTO(queue_size, m_queue.size());
+			const double drain_time = m_avg_latency * static_cast<double>(queue_size);
+			const AUTO(min_delay, std::min(g_save_delay_min, g_save_delay));
+			AUTO(delay, m_save_delay);
+			if((queue_size <= 1) || (drain_time >= static_cast<double>(delay))){
+				delay = std::max(delay / 2, min_delay);
+			} else if(drain_time * 4 < static_cast<double>(delay)){
+				delay = std::min(delay + delay / 4 + 1, g_save_delay);
+			}
+			if(delay != m_save_delay){
+				LOG_POSEIDON_TRACE("MySQL save delay changed: ", m_save_delay, " -> ", delay,
+					", queue_size = ", queue_size, ", avg_latency = ", m_avg_latency);
+				m_save_delay = delay;
+			}
+		}
+		void pop_front_operation(double latency){
+			boost::shared_ptr<JobPromise> queue_space;
+			{
+				const Mutex::UniqueLock lock(m_mutex);
+				m_queue.pop_front();
+				update_save_delay(latency);
+				// 降到上限的四分之三以下再唤醒生产者，避免反复等待。
+				if(m_queue_space && (m_queue.size() <= g_max_queue_length / 4 * 3)){
+					queue_space.swap(m_queue_space);
+				}
+			}
+			if(queue_space){
+				LOG_POSEIDON_DEBUG("MySQL queue has drained: queue_size_limit = ", g_max_queue_length);
+				try {
+					queue_space->set_success();
+				} catch(std::exception &e){
+					LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
+				}
+			}
+		}
+
+		void update_max_packet_size(const boost::shared_ptr<MySql::Connection> &conn) NOEXCEPT {
+			m_max_packet_size = 0;
+			try {
+				conn->execute_sql("SELECT @@max_allowed_packet AS `max_allowed_packet`");
+				if(conn->fetch_row()){
+					const AUTO(max_allowed_packet, conn->get_unsigned("max_allowed_packet"));
+					// 为报文头和转义留出余量。
+					if(max_allowed_packet > 1024){
+						m_max_packet_size = static_cast<std::size_t>(std::min<boost::uint64_t>(max_allowed_packet - 1024, std::numeric_limits<std::size_t>::max()));
+					}
+				}
+			} catch(std::exception &e){
+				LOG_POSEIDON_WARNING("Could not get max_allowed_packet: what = ", e.what());
+			}
+			conn->discard_result();
+			LOG_POSEIDON_DEBUG("MySQL max_allowed_packet = ", m_max_packet_size);
+		}
+
+		static void restore_taken_dirty_fields(const std::vector<std::pair<const MySql::ObjectBase *, std::vector<bool> > > &taken) NOEXCEPT {
+			for(AUTO(it, taken.begin()); it != taken.end(); ++it){
+				try {
+					it->first->restore_dirty_fields(it->second);
+				} catch(std::exception &e){
+					LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
+				}
+			}
+		}
+
+		// 把队首开始连续的、写入同一张表的 SaveOperation 合并成一条多行 INSERT 或 REPLACE 语句。
+		// 返回 true 表示已经处理了队首的操作。
+		bool batch_save_operations(const boost::shared_ptr<MySql::Connection> &conn, boost::uint64_t now) NOEXCEPT {
+			PROFILE_ME;
+
+			const std::size_t max_size = std::min(g_batch_max_size, m_max_packet_size);
+			if(max_size == 0){
+				return false;
+			}
+
+			std::vector<OperationQueueElement *> elems;
+			{
+				const Mutex::UniqueLock lock(m_mutex);
+				const bool urgent = atomic_load(m_urgent, ATOMIC_CONSUME);
+				for(AUTO(it, m_queue.begin()); it != m_queue.end(); ++it){
+					if(it->batched || it->unbatchable){
+						break;
+					}
+					if(!urgent && (now < it->due_time)){
+						break;
+					}
+					if(!dynamic_cast<const SaveOperation *>(it->operation.get())){
+						break;
+					}
+					elems.push_back(&*it);
+				}
+			}
+			if(elems.size() < 2){
+				return false;
+			}
+
+			const AUTO(first, static_cast<const SaveOperation *>(elems.front()->operation.get()));
+			const char *const table = first->get_object()->get_table();
+			const bool to_replace = first->is_to_replace();
+
+			std::string query;
+			std::size_t rows = 0;
+			// 已经取出修改标记的对象。没有写入时要还回去。
+			std::vector<std::pair<const MySql::ObjectBase *, std::vector<bool> > > taken;
+			try {
+				Buffer_ostream os;
+				if(to_replace){
+					os <<"REPLACE";
+				} else {
+					os <<"INSERT";
+				}
+				os <<" INTO `" <<table <<"` (";
+				first->get_object()->generate_sql_columns(os);
+				os <<") VALUES ";
+				query = os.get_buffer().dump_string();
+
+				boost::container::flat_set<const MySql::ObjectBase *> objects;
+				objects.reserve(elems.size());
+				taken.reserve(elems.size());
+				std::size_t count = 0;
+				while(count < elems.size()){
+					const AUTO(elem, elems.at(count));
+					const AUTO(save, static_cast<const SaveOperation *>(elem->operation.get()));
+					if((std::strcmp(save->get_object()->get_table(), table) != 0) || (save->is_to_replace() != to_replace)){
+						break;
+					}
+					const AUTO_REF(object, save->get_object());
+					const AUTO(write_stamp, object->get_combined_write_stamp());
+					// 与逐个执行时的判断相同。同一个对象只写入一次，写入的是它当前的值。
+					if((!write_stamp || (write_stamp == elem)) && !objects.count(object.get())){
+						// 先取出修改标记再生成值，这样之后的修改会留给下一次写入。
+						std::vector<bool> dirty_fields;
+						object->take_dirty_fields(dirty_fields);
+						Buffer_ostream row_os;
+						row_os <<(rows ? ", (" : "(");
+						object->generate_sql_values(row_os);
+						row_os <<")";
+						const AUTO(row, row_os.get_buffer().dump_string());
+						if((rows != 0) && (query.size() + row.size() > max_size)){
+							object->restore_dirty_fields(dirty_fields);
+							break;
+						}
+						query += row;
+						objects.insert(object.get());
+						taken.push_back(std::make_pair(object.get(), STD_MOVE(dirty_fields)));
+						++rows;
+					}
+					++count;
+				}
+				elems.resize(count);
+			} catch(std::exception &e){
+				LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
+				restore_taken_dirty_fields(taken);
+				return false;
+			}
+			if(rows < 2){
+				restore_taken_dirty_fields(taken);
+				return false;
+			}
+
+			const AUTO(begin, get_hi_res_mono_clock());
+			try {
+				LOG_POSEIDON_DEBUG("Executing batched SQL: table = ", table, ", rows = ", rows, ", operations = ", elems.size());
+				conn->execute_sql(query);
+			} catch(std::exception &e){
+				LOG_POSEIDON_WARNING("Batched MySQL save failed, retrying one by one: table = ", table, ", what = ", e.what());
+				conn->discard_result();
+				// 逐个执行时会重新取出修改标记。
+				restore_taken_dirty_fields(taken);
+				for(AUTO(it, elems.begin()); it != elems.end(); ++it){
+					(*it)->unbatchable = true;
+				}
+				return false;
+			}
+			conn->discard_result();
+
+			for(AUTO(it, elems.begin()); it != elems.end(); ++it){
+				const AUTO(elem, *it);
+				const AUTO(save, static_cast<const SaveOperation *>(elem->operation.get()));
+				const AUTO_REF(object, save->get_object());
+				if(object->get_combined_write_stamp() == elem){
+					object->set_combined_write_stamp(NULLPTR);
+				}
+				if(!elem->operation->is_satisfied()){
+					try {
+						elem->operation->set_success();
+					} catch(std::exception &e){
+						LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
+					}
+				}
+				elem->batched = true;
+			}
+
+			pop_front_operation((get_hi_res_mono_clock() - begin) / static_cast<double>(elems.size()));
+			return true;
+		}
+
 		bool pump_one_operation(boost::shared_ptr<MySql::Connection> &master_conn,
 			boost::shared_ptr<MySql::Connection> &slave_conn) NOEXCEPT
 		{
@@ -476,9 +1057,18 @@ namespace {
 				}
 				elem = &m_queue.front();
 			}
+			if(elem->batched){
+				// 执行时间在合并写入时已经计入，这里不改变平均值。
+				pop_front_operation(m_avg_latency);
+				return true;
+			}
 			const AUTO_REF(operation, elem->operation);
 			AUTO_REF(conn, elem->operation->should_use_slave() ? slave_conn : master_conn);
 
+			if(!elem->unbatchable && batch_save_operations(conn, now)){
+				return true;
+			}
+
 			std::string query;
 #ifdef POSEIDON_CXX11
 			std::exception_ptr except;
@@ -495,6 +1085,7 @@ namespace {
 				err_msg[len_] = 0;	\
 			} while(false)
 
+			const AUTO(begin, get_hi_res_mono_clock());
 			bool execute_it = false;
 			const AUTO(combinable_object, elem->operation->get_combinable_object());
 			if(!combinable_object){
@@ -510,9 +1101,11 @@ namespace {
 			}
 			if(execute_it){
 				try {
-					operation->generate_sql(query);
-					LOG_POSEIDON_DEBUG("Executing SQL: table = ", operation->get_table(), ", query = ", query);
-					operation->execute(conn, query);
+					if(!operation->execute_prepared(conn)){
+						operation->generate_sql(query);
+						LOG_POSEIDON_DEBUG("Executing SQL: table = ", operation->get_table(), ", query = ", query);
+						operation->execute(conn, query);
+					}
 				} catch(MySql::Exception &e){
 					LOG_POSEIDON_WARNING("MySql::Exception thrown: code = ", e.get_code(), ", what = ", e.what());
 #ifdef POSEIDON_CXX11
@@ -550,7 +1143,20 @@ namespace {
 					return true;
 				}
 				LOG_POSEIDON_ERROR("Max retry count exceeded.");
+				if(query.empty()){
+					// 预处理语句没有生成 SQL 文本，转储时再生成。
+					try {
+						operation->generate_sql(query);
+					} catch(std::exception &e){
+						LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
+					}
+				}
 				dump_sql_to_file(query, err_code, err_msg);
+				// 这次写入的字段没有保存成功，下次写入时要包含它们。
+				const AUTO(save, dynamic_cast<const SaveOperation *>(operation.get()));
+				if(save){
+					save->restore_dirty_fields();
+				}
 			}
 			if(!elem->operation->is_satisfied()){
 				try {
@@ -563,8 +1169,7 @@ namespace {
 					LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
 				}
 			}
-			const Mutex::UniqueLock lock(m_mutex);
-			m_queue.pop_front();
+			pop_front_operation(get_hi_res_mono_clock() - begin);
 			return true;
 		}
 
@@ -575,7 +1180,6 @@ namespace {
 			const MySql::ThreadContext thread_context;
 			boost::shared_ptr<MySql::Connection> master_conn, slave_conn;
 
-			unsigned timeout = 0;
 			for(;;){
 				bool busy;
 				do {
@@ -584,6 +1188,7 @@ namespace {
 						try {
 							master_conn = real_create_connection(false);
 							LOG_POSEIDON_INFO("Successfully connected to MySQL master server.");
+							update_max_packet_size(master_conn);
 						} catch(std::exception &e){
 							LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
 							::timespec req;
@@ -610,14 +1215,22 @@ namespace {
 						}
 					}
 					busy = pump_one_operation(master_conn, slave_conn);
-					timeout = std::min<unsigned>(timeout * 2u + 1u, !busy * 100u);
 				} while(busy);
 
 				Mutex::UniqueLock lock(m_mutex);
 				if(!atomic_load(m_running, ATOMIC_CONSUME)){
 					break;
 				}
-				m_new_operation.timed_wait(lock, timeout);
+				// 必须在锁内重新检查队列，否则在此之前投递的操作的通知会丢失。
+				if(m_queue.empty()){
+					m_new_operation.wait(lock);
+				} else if(!atomic_load(m_urgent, ATOMIC_CONSUME)){
+					const AUTO(now, get_fast_mono_clock());
+					const AUTO(due_time, m_queue.front().due_time);
+					if(now < due_time){
+						m_new_operation.timed_wait(lock, due_time - now);
+					}
+				}
 			}
 
 			LOG_POSEIDON_INFO("MySQL thread stopped.");
@@ -630,7 +1243,9 @@ namespace {
 			atomic_store(m_running, true, ATOMIC_RELEASE);
 		}
 		void stop(){
+			const Mutex::UniqueLock lock(m_mutex);
 			atomic_store(m_running, false, ATOMIC_RELEASE);
+			m_new_operation.signal();
 		}
 		void safe_join(){
 			wait_till_idle();
@@ -668,20 +1283,31 @@ namespace {
 			const Mutex::UniqueLock lock(m_mutex);
 			return m_queue.size();
 		}
+		// 队列没有超过上限时返回空指针。
+		boost::shared_ptr<const JobPromise> get_queue_space_promise(){
+			const Mutex::UniqueLock lock(m_mutex);
+			if((g_max_queue_length == 0) || (m_queue.size() < g_max_queue_length)){
+				return VAL_INIT;
+			}
+			if(!m_queue_space){
+				LOG_POSEIDON_WARNING("MySQL queue is full: queue_size = ", m_queue.size());
+				m_queue_space = boost::make_shared<JobPromise>();
+			}
+			return m_queue_space;
+		}
 		void add_operation(boost::shared_ptr<OperationBase> operation, bool urgent){
 			PROFILE_ME;
 
 			const AUTO(combinable_object, operation->get_combinable_object());
-
-			AUTO(due_time, get_fast_mono_clock());
-			// 有紧急操作时无视写入延迟，这个逻辑不在这里处理。
-			due_time += g_save_delay;
+			const AUTO(now, get_fast_mono_clock());
 
 			const Mutex::UniqueLock lock(m_mutex);
 			if(!atomic_load(m_running, ATOMIC_CONSUME)){
 				LOG_POSEIDON_ERROR("MySQL thread is being shut down.");
 				DEBUG_THROW(Exception, sslit("MySQL thread is being shut down"));
 			}
+			// 有紧急操作时无视写入延迟，这个逻辑不在这里处理。
+			const AUTO(due_time, now + m_save_delay);
 			m_queue.push_back(OperationQueueElement(STD_MOVE(operation), due_time));
 			OperationQueueElement *const elem = &m_queue.back();
 			if(combinable_object){
@@ -705,9 +1331,107 @@ namespace {
 		boost::shared_ptr<MySqlThread> thread;
 	};
 	boost::container::flat_map<SharedNts, Route> g_router;
+	// 分片表的每个分片各有一个路由。表和列在启动时读取，之后只有路由会改变。
+	struct ShardedTable {
+		std::string column;
+		std::vector<Route> routes;
+	};
+	boost::container::flat_map<SharedNts, ShardedTable> g_sharded_tables;
 	boost::container::flat_multimap<std::size_t, std::size_t> g_routing_map;
 	std::vector<boost::shared_ptr<MySqlThread> > g_threads;
 
+	std::size_t get_shard_index(const ShardedTable &sharded, const char *table, const MySql::ObjectBase &object){
+		PROFILE_ME;
+
+		const std::size_t field_count = object.get_field_count();
+		for(std::size_t i = 0; i < field_count; ++i){
+			if(sharded.column != object.get_field_name(i)){
+				continue;
+			}
+			Crc32_ostream os;
+			object.generate_sql_field_value(os, i);
+			return os.finalize() % sharded.routes.size();
+		}
+		LOG_POSEIDON_WARNING("Shard column not found: table = ", table, ", column = ", sharded.column);
+		return 0;
+	}
+
+	// 必须在 g_router_mutex 锁定的情况下调用。
+	// 路由上还有未完成的操作时沿用原来的线程，否则选择队列最短的线程。队列长度相同时优先选择第 hint 个线程。
+	void pin_route(boost::shared_ptr<const void> &probe, boost::shared_ptr<MySqlThread> &thread,
+		Route &route, const char *table, std::size_t hint)
+	{
+		if(route.probe.use_count() > 1){
+			probe = route.probe;
+			thread = route.thread;
+			return;
+		}
+		if(!route.probe){
+			route.probe = boost::make_shared<int>();
+		}
+		probe = route.probe;
+
+		g_routing_map.clear();
+		g_routing_map.reserve(g_threads.size());
+		for(std::size_t j = 0; j < g_threads.size(); ++j){
+			const std::size_t i = (hint + j) % g_threads.size();
+			AUTO_REF(test_thread, g_threads.at(i));
+			if(!test_thread){
+				LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_DEBUG,
+					"Creating new MySQL thread ", i, " for table ", table);
+				thread = boost::make_shared<MySqlThread>();
+				thread->start();
+				test_thread = thread;
+				route.thread = thread;
+				return;
+			}
+			const AUTO(queue_size, test_thread->get_queue_size());
+			LOG_POSEIDON_DEBUG("> MySQL thread ", i, "'s queue size: ", queue_size);
+			g_routing_map.emplace(queue_size, i);
+		}
+		if(g_routing_map.empty()){
+			LOG_POSEIDON_FATAL("No available MySQL thread?!");
+			std::abort();
+		}
+		const AUTO(index, g_routing_map.begin()->second);
+		LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_DEBUG,
+			"Picking thread ", index, " for table ", table);
+		thread = g_threads.at(index);
+		route.thread = thread;
+	}
+
+	void submit_operation_to_shards(ShardedTable &sharded, const char *table, boost::shared_ptr<OperationBase> operation, bool urgent){
+		PROFILE_ME;
+
+		// 同一个线程只投递一次，否则它会等待排在自己后面的操作。
+		boost::container::flat_map<boost::shared_ptr<MySqlThread>, std::vector<boost::shared_ptr<const void> > > threads;
+		for(std::size_t i = 0; i < sharded.routes.size(); ++i){
+			boost::shared_ptr<const void> probe;
+			boost::shared_ptr<MySqlThread> thread;
+			pin_route(probe, thread, sharded.routes.at(i), table, i);
+			threads[STD_MOVE(thread)].push_back(STD_MOVE(probe));
+		}
+		LOG_POSEIDON_DEBUG("Submitting MySQL operation to shards: table = ", table, ", threads = ", threads.size());
+		const AUTO(barrier, boost::make_shared<ShardBarrier>(threads.size()));
+		std::size_t queued = 0;
+		try {
+			for(AUTO(it, threads.begin()); it != threads.end(); ++it){
+				AUTO(barrier_operation, boost::make_shared<BarrierOperation>(operation, barrier));
+				for(AUTO(pit, it->second.begin()); pit != it->second.end(); ++pit){
+					barrier_operation->add_probe(STD_MOVE(*pit));
+				}
+				// 在锁内投递，使得所有线程中屏障的先后顺序一致，不会互相等待。
+				it->first->add_operation(STD_MOVE_IDN(barrier_operation), urgent);
+				++queued;
+			}
+		} catch(...){
+			// 已经投递的线程不能一直等待下去。
+			LOG_POSEIDON_WARNING("Failed to submit MySQL operation to all shards: table = ", table, ", queued = ", queued, ", threads = ", threads.size());
+			barrier->cancel(threads.size() - queued);
+			throw;
+		}
+	}
+
 	void submit_operation_by_table(const char *table, boost::shared_ptr<OperationBase> operation, bool urgent){
 		PROFILE_ME;
 
@@ -715,46 +1439,36 @@ namespace {
 		boost::shared_ptr<MySqlThread> thread;
 		{
 			const Mutex::UniqueLock lock(g_router_mutex);
-
-			AUTO_REF(route, g_router[SharedNts::view(table)]);
-			if(route.probe.use_count() > 1){
-				probe = route.probe;
-				thread = route.thread;
-				goto _use_thread;
-			}
-			if(!route.probe){
-				route.probe = boost::make_shared<int>();
+			const AUTO(it, g_sharded_tables.find(SharedNts::view(table)));
+			if(it != g_sharded_tables.end()){
+				submit_operation_to_shards(it->second, table, STD_MOVE(operation), urgent);
+				return;
 			}
-			probe = route.probe;
+			pin_route(probe, thread, g_router[SharedNts::view(table)], table, 0);
+		}
+		assert(probe);
+		assert(thread);
+		operation->set_probe(STD_MOVE(probe));
+		thread->add_operation(STD_MOVE(operation), urgent);
+	}
+	void submit_operation_by_object(const MySql::ObjectBase &object, boost::shared_ptr<OperationBase> operation, bool urgent){
+		PROFILE_ME;
+
+		const char *const table = object.get_table();
+		const AUTO(it, g_sharded_tables.find(SharedNts::view(table)));
+		if(it == g_sharded_tables.end()){
+			submit_operation_by_table(table, STD_MOVE(operation), urgent);
+			return;
+		}
+		// 同一个键总是落在同一个分片上，因此对同一行的操作保持顺序。
+		const AUTO(shard, get_shard_index(it->second, table, object));
 
-			g_routing_map.clear();
-			g_routing_map.reserve(g_threads.size());
-			for(std::size_t i = 0; i < g_threads.size(); ++i){
-				AUTO_REF(test_thread, g_threads.at(i));
-				if(!test_thread){
-					LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_DEBUG,
-						"Creating new MySQL thread ", i, " for table ", table);
-					thread = boost::make_shared<MySqlThread>();
-					thread->start();
-					test_thread = thread;
-					route.thread = thread;
-					goto _use_thread;
-				}
-				const AUTO(queue_size, test_thread->get_queue_size());
-				LOG_POSEIDON_DEBUG("> MySQL thread ", i, "'s queue size: ", queue_size);
-				g_routing_map.emplace(queue_size, i);
-			}
-			if(g_routing_map.empty()){
-				LOG_POSEIDON_FATAL("No available MySQL thread?!");
-				std::abort();
-			}
-			const AUTO(index, g_routing_map.begin()->second);
-			LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_DEBUG,
-				"Picking thread ", index, " for table ", table);
-			thread = g_threads.at(index);
-			route.thread = thread;
-		}
-	_use_thread:
+		boost::shared_ptr<const void> probe;
+		boost::shared_ptr<MySqlThread> thread;
+		{
+			const Mutex::UniqueLock lock(g_router_mutex);
+			pin_route(probe, thread, it->second.routes.at(shard), table, shard);
+		}
 		assert(probe);
 		assert(thread);
 		operation->set_probe(STD_MOVE(probe));
@@ -774,6 +1488,58 @@ namespace {
 	}
 }
 
+namespace {
+	typedef JobPromiseContainer<boost::shared_ptr<MySql::ObjectBase> > CachedObjectPromise;
+
+	// 身份映射缓存。同一张表中主键相同的行只保留一个对象，由所有读取者共享。
+	struct CacheElement {
+		std::pair<SharedNts, std::string> key;
+		boost::uint64_t serial; // 最近一次访问的序号，越小的越久没有被访问。
+		boost::shared_ptr<CachedObjectPromise> promise;
+
+		CacheElement(SharedNts table_, std::string key_, boost::uint64_t serial_, boost::shared_ptr<CachedObjectPromise> promise_)
+			: key(STD_MOVE(table_), STD_MOVE(key_)), serial(serial_), promise(STD_MOVE(promise_))
+		{
+		}
+	};
+	MULTI_INDEX_MAP(CacheMap, CacheElement,
+		UNIQUE_MEMBER_INDEX(key)
+		MULTI_MEMBER_INDEX(serial)
+	)
+
+	Mutex g_cache_mutex;
+	CacheMap g_cache_map;
+	boost::uint64_t g_cache_serial = 0;
+
+	// 正在读取的，或者在缓存之外还有人引用的（包括尚未写入的保存操作）对象不能被淘汰，
+	// 否则再次读取时会得到另一个对象。调用者可能只持有 promise，通过它访问对象，也算在内。
+	bool is_cached_object_in_use(const CacheElement &elem){
+		if(!elem.promise->is_satisfied()){
+			return true;
+		}
+		if(elem.promise.use_count() > 1){
+			return true;
+		}
+		const AUTO(object, elem.promise->try_get());
+		if(!object){
+			return false;
+		}
+		return !object->unique();
+	}
+	// 必须在 g_cache_mutex 锁定的情况下调用。
+	void shrink_cache(){
+		for(AUTO(count, g_cache_map.size()); (count != 0) && (g_cache_map.size() > g_cache_max_objects); --count){
+			const AUTO(it, g_cache_map.begin<1>());
+			if(is_cached_object_in_use(*it)){
+				g_cache_map.set_key<1, 1>(it, ++g_cache_serial);
+				continue;
+			}
+			LOG_POSEIDON_TRACE("Evicting cached MySQL object: table = ", it->key.first, ", key = ", it->key.second);
+			g_cache_map.erase<1>(it);
+		}
+	}
+}
+
 void MySqlDaemon::start(){
 	if(atomic_exchange(g_running, true, ATOMIC_ACQ_REL) != false){
 		LOG_POSEIDON_FATAL("Only one daemon is allowed at the same time.");
@@ -814,6 +1580,15 @@ void MySqlDaemon::start(){
 	MainConfig::get(g_save_delay, "mysql_save_delay");
 	LOG_POSEIDON_DEBUG("MySQL save delay = ", g_save_delay);
 
+	MainConfig::get(g_save_delay_min, "mysql_save_delay_min");
+	LOG_POSEIDON_DEBUG("MySQL save delay min = ", g_save_delay_min);
+
+	MainConfig::get(g_max_queue_length, "mysql_max_queue_length");
+	LOG_POSEIDON_DEBUG("MySQL max queue length = ", g_max_queue_length);
+
+	MainConfig::get(g_cache_max_objects, "mysql_cache_max_objects");
+	LOG_POSEIDON_DEBUG("MySQL cache max objects = ", g_cache_max_objects);
+
 	MainConfig::get(g_reconn_delay, "mysql_reconn_delay");
 	LOG_POSEIDON_DEBUG("MySQL reconnect delay = ", g_reconn_delay);
 
@@ -826,6 +1601,38 @@ void MySqlDaemon::start(){
 	MainConfig::get(g_max_thread_count, "mysql_max_thread_count");
 	LOG_POSEIDON_DEBUG("MySQL max thread count = ", g_max_thread_count);
 
+	MainConfig::get(g_batch_max_size, "mysql_batch_max_size");
+	LOG_POSEIDON_DEBUG("MySQL batch max size = ", g_batch_max_size);
+
+	MainConfig::get(g_use_prepared, "mysql_use_prepared_statements");
+	LOG_POSEIDON_DEBUG("MySQL use prepared statements = ", g_use_prepared);
+
+	const AUTO(sharded_tables, MainConfig::get_all<std::string>("mysql_sharded_table"));
+	for(AUTO(it, sharded_tables.begin()); it != sharded_tables.end(); ++it){
+		const AUTO(pos1, it->find(':'));
+		const AUTO(pos2, (pos1 == std::string::npos) ? pos1 : it->find(':', pos1 + 1));
+		if(pos2 == std::string::npos){
+			LOG_POSEIDON_FATAL("Invalid mysql_sharded_table: ", *it);
+			std::abort();
+		}
+		std::string table = it->substr(0, pos1);
+		ShardedTable sharded;
+		sharded.column = it->substr(pos1 + 1, pos2 - pos1 - 1);
+		std::size_t shard_count = 0;
+		try {
+			shard_count = boost::lexical_cast<std::size_t>(it->substr(pos2 + 1));
+		} catch(std::exception &e){
+			LOG_POSEIDON_DEBUG("std::exception thrown: what = ", e.what());
+		}
+		if(table.empty() || sharded.column.empty() || (shard_count == 0)){
+			LOG_POSEIDON_FATAL("Invalid mysql_sharded_table: ", *it);
+			std::abort();
+		}
+		sharded.routes.resize(shard_count);
+		LOG_POSEIDON_DEBUG("MySQL sharded table: table = ", table, ", column = ", sharded.column, ", shard_count = ", shard_count);
+		g_sharded_tables[SharedNts(table)] = STD_MOVE(sharded);
+	}
+
 	if(!g_dump_dir.empty()){
 		const AUTO(placeholder_path, g_dump_dir + "/placeholder");
 		LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO,
@@ -866,6 +1673,9 @@ void MySqlDaemon::stop(){
 	}
 	g_threads.clear();
 
+	const Mutex::UniqueLock lock(g_cache_mutex);
+	g_cache_map.clear();
+
 	LOG_POSEIDON_INFO("MySQL daemon stopped.");
 }
 
@@ -883,13 +1693,32 @@ void MySqlDaemon::wait_for_all_async_operations(){
 	}
 }
 
+boost::shared_ptr<const JobPromise> MySqlDaemon::get_queue_space_promise(){
+	PROFILE_ME;
+
+	const Mutex::UniqueLock lock(g_router_mutex);
+	for(AUTO(it, g_threads.begin()); it != g_threads.end(); ++it){
+		const AUTO_REF(thread, *it);
+		if(!thread){
+			continue;
+		}
+		const AUTO(promise, thread->get_queue_space_promise());
+		if(promise){
+			return promise;
+		}
+	}
+	AUTO(promise, boost::make_shared<JobPromise>());
+	promise->set_success();
+	return STD_MOVE_IDN(promise);
+}
+
 boost::shared_ptr<const JobPromise> MySqlDaemon::enqueue_for_saving(
 	boost::shared_ptr<const MySql::ObjectBase> object, bool to_replace, bool urgent)
 {
 	AUTO(promise, boost::make_shared<JobPromise>());
-	const char *const table = object->get_table();
+	const AUTO_REF(object_ref, *object);
 	AUTO(operation, boost::make_shared<SaveOperation>(promise, STD_MOVE(object), to_replace));
-	submit_operation_by_table(table, STD_MOVE_IDN(operation), urgent);
+	submit_operation_by_object(object_ref, STD_MOVE_IDN(operation), urgent);
 	return STD_MOVE_IDN(promise);
 }
 boost::shared_ptr<const JobPromise> MySqlDaemon::enqueue_for_loading(
@@ -903,6 +1732,62 @@ boost::shared_ptr<const JobPromise> MySqlDaemon::enqueue_for_loading(
 	submit_operation_by_table(table, STD_MOVE_IDN(operation), true);
 	return STD_MOVE_IDN(promise);
 }
+boost::shared_ptr<const JobPromiseContainer<boost::shared_ptr<MySql::ObjectBase> > > MySqlDaemon::enqueue_for_cached_loading(
+	boost::shared_ptr<MySql::ObjectBase> object, std::string key, std::string query)
+{
+	DEBUG_THROW_ASSERT(!query.empty());
+
+	const char *const table = object->get_table();
+	AUTO(promise, boost::make_shared<CachedObjectPromise>(object));
+	if(g_cache_max_objects == 0){
+		AUTO(operation, boost::make_shared<LoadOperation>(promise, STD_MOVE(object), STD_MOVE(query)));
+		submit_operation_by_table(table, STD_MOVE_IDN(operation), true);
+		return STD_MOVE_IDN(promise);
+	}
+	{
+		const Mutex::UniqueLock lock(g_cache_mutex);
+		const AUTO(it, g_cache_map.find<0>(std::make_pair(SharedNts::view(table), key)));
+		if(it != g_cache_map.end<0>()){
+			const AUTO_REF(cached_promise, it->promise);
+			if(!cached_promise->is_satisfied() || !cached_promise->would_throw()){
+				// 命中缓存，或者有相同的读取正在进行。
+				LOG_POSEIDON_TRACE("Reusing cached MySQL object: table = ", table, ", key = ", key);
+				g_cache_map.set_key<0, 1>(it, ++g_cache_serial);
+				return cached_promise;
+			}
+			// 上次读取失败了，重新读取。
+			g_cache_map.erase<0>(it);
+		}
+		g_cache_map.insert(CacheElement(SharedNts(table), key, ++g_cache_serial, promise));
+		shrink_cache();
+	}
+	// 读取与写入按相同的规则路由，因此会排在这个对象所有尚未完成的写入之后。
+	AUTO(operation, boost::make_shared<LoadOperation>(promise, STD_MOVE(object), STD_MOVE(query)));
+	try {
+		submit_operation_by_table(table, STD_MOVE_IDN(operation), true);
+	} catch(std::exception &e){
+		LOG_POSEIDON_WARNING("std::exception thrown: what = ", e.what());
+		{
+			const Mutex::UniqueLock lock(g_cache_mutex);
+			const AUTO(it, g_cache_map.find<0>(std::make_pair(SharedNts::view(table), key)));
+			if((it != g_cache_map.end<0>()) && (it->promise == promise)){
+				g_cache_map.erase<0>(it);
+			}
+		}
+		// 其他读取者可能已经拿到了这个 promise。
+#ifdef POSEIDON_CXX11
+		promise->set_exception(std::current_exception());
+#else
+		promise->set_exception(boost::copy_exception(std::runtime_error(e.what())));
+#endif
+		throw;
+	}
+	return STD_MOVE_IDN(promise);
+}
+void MySqlDaemon::evict_cached_object(const char *table, const std::string &key){
+	const Mutex::UniqueLock lock(g_cache_mutex);
+	g_cache_map.erase<0>(std::make_pair(SharedNts::view(table), key));
+}
 boost::shared_ptr<const JobPromise> MySqlDaemon::enqueue_for_deleting(
 	const char *table_hint, std::string query)
 {
@@ -17,6 +17,8 @@ namespace MySql {
 }
 
 class JobPromise;
+template<typename>
+class JobPromiseContainer;
 
 class MySqlDaemon {
 private:
@@ -32,12 +34,22 @@ public:
 	static boost::shared_ptr<MySql::Connection> create_connection(bool from_slave = false);
 
 	static void wait_for_all_async_operations();
+	// 任何一个数据库线程的队列超过 mysql_max_queue_length 时，返回的 promise 在队列降下来之后才被满足。
+	// 大量写入的生产者应当在适当的位置对其调用 yield()，不能在持有对象的锁时调用。
+	static boost::shared_ptr<const JobPromise> get_queue_space_promise();
 
 	// 异步接口。
 	static boost::shared_ptr<const JobPromise> enqueue_for_saving(
 		boost::shared_ptr<const MySql::ObjectBase> object, bool to_replace, bool urgent);
 	static boost::shared_ptr<const JobPromise> enqueue_for_loading(
 		boost::shared_ptr<MySql::ObjectBase> object, std::string query);
+	// 带缓存的读取，mysql_cache_max_objects 为 0 时等同于 enqueue_for_loading()。
+	// key 是调用者给出的主键的值。同一张表中 key 相同的行共享同一个对象，同时发起的读取共享同一个查询。
+	// 读取完成之后应当使用 promise 中的对象，而不是传入的 object。
+	static boost::shared_ptr<const JobPromiseContainer<boost::shared_ptr<MySql::ObjectBase> > > enqueue_for_cached_loading(
+		boost::shared_ptr<MySql::ObjectBase> object, std::string key, std::string query);
+	// 删除一行之后应当把它从缓存中移除。
+	static void evict_cached_object(const char *table, const std::string &key);
 	static boost::shared_ptr<const JobPromise> enqueue_for_deleting(
 		const char *table_hint, std::string query);
 	static boost::shared_ptr<const JobPromise> enqueue_for_batch_loading(
@@ -5,6 +5,7 @@
 #include "profile_depository.hpp"
 #include <boost/container/flat_map.hpp>
 #include <cstring>
+#include <pthread.h>
 #include "main_config.hpp"
 #include "../mutex.hpp"
 #include "../atomic.hpp"
@@ -33,21 +34,177 @@ namespace {
 		}
 	};
 
+	// 对数线性直方图。小于 8 纳秒的值各占一个桶，此后每个 2 的幂次区间均分为 8 个桶，相对误差不超过 12.5%。
+	// 超过 2^40 纳秒（约 18 分钟）的值都计入最后一个桶。
+	enum {
+		HIST_SUB_BITS      = 3,
+		HIST_SUB_COUNT     = 1 << HIST_SUB_BITS,
+		HIST_MAX_EXPONENT  = 39,
+		HIST_BUCKET_COUNT  = (HIST_MAX_EXPONENT - HIST_SUB_BITS + 2) * HIST_SUB_COUNT,
+	};
+
+	unsigned get_histogram_index(unsigned long long ns) NOEXCEPT {
+		if(ns < HIST_SUB_COUNT){
+			return static_cast<unsigned>(ns);
+		}
+		const unsigned exponent = 63 - static_cast<unsigned>(__builtin_clzll(ns));
+		if(exponent > HIST_MAX_EXPONENT){
+			return HIST_BUCKET_COUNT - 1;
+		}
+		const unsigned sub = static_cast<unsigned>(ns >> (exponent - HIST_SUB_BITS)) & (HIST_SUB_COUNT - 1);
+		return (exponent - HIST_SUB_BITS + 1) * HIST_SUB_COUNT + sub;
+	}
+	// 桶中最大的值。
+	unsigned long long get_histogram_upper_bound(unsigned index) NOEXCEPT {
+		if(index < HIST_SUB_COUNT){
+			return index;
+		}
+		const unsigned exponent = index / HIST_SUB_COUNT + HIST_SUB_BITS - 1;
+		const unsigned sub = index % HIST_SUB_COUNT;
+		const unsigned shift = exponent - HIST_SUB_BITS;
+		return (((unsigned long long)(HIST_SUB_COUNT + sub) << shift) + ((1ull << shift) - 1));
+	}
+
 	struct ProfileCounters {
 		volatile unsigned long long samples;
 		volatile unsigned long long ns_total;
 		volatile unsigned long long ns_exclusive;
 
+		// 直方图只统计上次重置以来的样本。
+		volatile unsigned long long ns_max;
+		volatile boost::uint32_t histogram[HIST_BUCKET_COUNT];
+
 		ProfileCounters()
 			: samples(0), ns_total(0), ns_exclusive(0)
+			, ns_max(0)
 		{
+			for(unsigned i = 0; i < HIST_BUCKET_COUNT; ++i){
+				histogram[i] = 0;
+			}
 		}
 	};
 
+	typedef boost::container::flat_map<ProfileKey, ProfileCounters> ProfileMap;
+
+	// 每个线程独占一个分片，计数器只由所在的线程累加。
+	// 其他线程只会读取或者清零计数器，因此只有插入新的键时才需要锁定分片。
+	struct ProfileShard : NONCOPYABLE {
+		Mutex mutex;
+		ProfileMap profile;
+	};
+
 	bool g_enabled = true;
 
 	Mutex g_mutex;
-	boost::container::flat_map<ProfileKey, ProfileCounters> g_profile;
+	std::vector<ProfileShard *> g_shards;
+	// 已经退出的线程的数据。
+	ProfileMap g_retired_profile;
+
+	__thread ProfileShard *t_shard;
+
+	::pthread_once_t g_shard_key_once = PTHREAD_ONCE_INIT;
+	::pthread_key_t g_shard_key;
+
+	// dst 只由调用者访问。如果 reset_window 为 true，src 中的直方图在读取的同时被清零，重置期间的样本不会丢失。
+	void merge_counters(ProfileCounters &dst, ProfileCounters &src, bool reset_window) NOEXCEPT {
+		dst.samples      += atomic_load(src.samples, ATOMIC_RELAXED);
+		dst.ns_total     += atomic_load(src.ns_total, ATOMIC_RELAXED);
+		dst.ns_exclusive += atomic_load(src.ns_exclusive, ATOMIC_RELAXED);
+
+		unsigned long long ns_max;
+		if(reset_window){
+			ns_max = atomic_exchange(src.ns_max, 0, ATOMIC_RELAXED);
+		} else {
+			ns_max = atomic_load(src.ns_max, ATOMIC_RELAXED);
+		}
+		if(dst.ns_max < ns_max){
+			dst.ns_max = ns_max;
+		}
+		for(unsigned i = 0; i < HIST_BUCKET_COUNT; ++i){
+			boost::uint32_t count;
+			if(reset_window){
+				count = atomic_exchange(src.histogram[i], 0, ATOMIC_RELAXED);
+			} else {
+				count = atomic_load(src.histogram[i], ATOMIC_RELAXED);
+			}
+			dst.histogram[i] += count;
+		}
+	}
+	void reset_counters(ProfileCounters &counters) NOEXCEPT {
+		atomic_store(counters.samples,      0, ATOMIC_RELAXED);
+		atomic_store(counters.ns_total,     0, ATOMIC_RELAXED);
+		atomic_store(counters.ns_exclusive, 0, ATOMIC_RELAXED);
+		atomic_store(counters.ns_max,       0, ATOMIC_RELAXED);
+		for(unsigned i = 0; i < HIST_BUCKET_COUNT; ++i){
+			atomic_store(counters.histogram[i], 0, ATOMIC_RELAXED);
+		}
+	}
+
+	// 返回至少 permille / 1000 的样本所不超过的值。
+	unsigned long long get_percentile(const ProfileCounters &counters, unsigned long long window_samples, unsigned permille) NOEXCEPT {
+		const unsigned long long ns_max = counters.ns_max;
+		if(window_samples == 0){
+			return 0;
+		}
+		const unsigned long long target = (window_samples * permille + 999) / 1000;
+		unsigned long long accumulated = 0;
+		for(unsigned i = 0; i < HIST_BUCKET_COUNT; ++i){
+			accumulated += counters.histogram[i];
+			if(accumulated >= target){
+				return std::min(get_histogram_upper_bound(i), ns_max);
+			}
+		}
+		return ns_max;
+	}
+
+	// 线程退出时把分片中的数据合并到 g_retired_profile 中。
+	void shard_key_destructor(void *ptr) NOEXCEPT {
+		const AUTO(shard, static_cast<ProfileShard *>(ptr));
+		t_shard = NULLPTR;
+		try {
+			const Mutex::UniqueLock lock(g_mutex);
+			for(AUTO(it, shard->profile.begin()); it != shard->profile.end(); ++it){
+				merge_counters(g_retired_profile[it->first], it->second, false);
+			}
+			g_shards.erase(std::find(g_shards.begin(), g_shards.end(), shard));
+		} catch(...){
+		}
+		delete shard;
+	}
+	void init_shard_key() NOEXCEPT {
+		const int err_code = ::pthread_key_create(&g_shard_key, &shard_key_destructor);
+		if(err_code != 0){
+			LOG_POSEIDON_FATAL("::pthread_key_create() failed with error code ", err_code);
+			std::abort();
+		}
+	}
+
+	ProfileShard *require_thread_shard(){
+		AUTO(shard, t_shard);
+		if(shard){
+			return shard;
+		}
+		int err_code = ::pthread_once(&g_shard_key_once, &init_shard_key);
+		if(err_code != 0){
+			LOG_POSEIDON_FATAL("::pthread_once() failed with error code ", err_code);
+			std::abort();
+		}
+		shard = new ProfileShard;
+		try {
+			const Mutex::UniqueLock lock(g_mutex);
+			g_shards.push_back(shard);
+		} catch(...){
+			delete shard;
+			throw;
+		}
+		err_code = ::pthread_setspecific(g_shard_key, shard);
+		if(err_code != 0){
+			LOG_POSEIDON_FATAL("::pthread_setspecific() failed with error code ", err_code);
+			std::abort();
+		}
+		t_shard = shard;
+		return shard;
+	}
 }
 
 void ProfileDepository::start(){
@@ -66,23 +223,49 @@ bool ProfileDepository::is_enabled(){
 
 void ProfileDepository::accumulate(const char *file, unsigned long line, const char *func, double total, double exclusive) NOEXCEPT {
 	try {
-		const Mutex::UniqueLock lock(g_mutex);
-		AUTO_REF(counters, g_profile[ProfileKey(file, line, func)]);
+		const AUTO(shard, require_thread_shard());
+		const ProfileKey key(file, line, func);
+		// 只有当前线程会修改自己的分片，因此查找无需加锁。
+		AUTO(it, shard->profile.find(key));
+		if(it == shard->profile.end()){
+			const Mutex::UniqueLock lock(shard->mutex);
+			it = shard->profile.emplace(key, ProfileCounters()).first;
+		}
+		AUTO_REF(counters, it->second);
+		const AUTO(ns_total, static_cast<unsigned long long>(total * 1e6));
 		atomic_add(counters.samples,      1,               ATOMIC_RELAXED);
-		atomic_add(counters.ns_total,     total * 1e6,     ATOMIC_RELAXED);
+		atomic_add(counters.ns_total,     ns_total,        ATOMIC_RELAXED);
 		atomic_add(counters.ns_exclusive, exclusive * 1e6, ATOMIC_RELAXED);
+		atomic_add(counters.histogram[get_histogram_index(ns_total)], 1, ATOMIC_RELAXED);
+		if(atomic_load(counters.ns_max, ATOMIC_RELAXED) < ns_total){
+			atomic_store(counters.ns_max, ns_total, ATOMIC_RELAXED);
+		}
 	} catch(...){
 	}
 }
 
-std::vector<ProfileDepository::SnapshotElement> ProfileDepository::snapshot(){
+std::vector<ProfileDepository::SnapshotElement> ProfileDepository::snapshot(bool reset_window){
 	Profiler::accumulate_all_in_thread();
 
-	std::vector<SnapshotElement> ret;
+	ProfileMap profile;
 	{
 		const Mutex::UniqueLock lock(g_mutex);
-		ret.reserve(g_profile.size());
-		for(AUTO(it, g_profile.begin()); it != g_profile.end(); ++it){
+		for(AUTO(it, g_retired_profile.begin()); it != g_retired_profile.end(); ++it){
+			merge_counters(profile[it->first], it->second, reset_window);
+		}
+		for(AUTO(sit, g_shards.begin()); sit != g_shards.end(); ++sit){
+			const AUTO(shard, *sit);
+			const Mutex::UniqueLock shard_lock(shard->mutex);
+			for(AUTO(it, shard->profile.begin()); it != shard->profile.end(); ++it){
+				merge_counters(profile[it->first], it->second, reset_window);
+			}
+		}
+	}
+
+	std::vector<SnapshotElement> ret;
+	{
+		ret.reserve(profile.size());
+		for(AUTO(it, profile.begin()); it != profile.end(); ++it){
 			const AUTO_REF(key, it->first);
 			const AUTO_REF(counters, it->second);
 			SnapshotElement elem;
@@ -92,6 +275,16 @@ std::vector<ProfileDepository::SnapshotElement> ProfileDepository::snapshot(){
 			elem.samples      = atomic_load(counters.samples, ATOMIC_RELAXED);
 			elem.ns_total     = atomic_load(counters.ns_total, ATOMIC_RELAXED);
 			elem.ns_exclusive = atomic_load(counters.ns_exclusive, ATOMIC_RELAXED);
+			unsigned long long window_samples = 0;
+			for(unsigned i = 0; i < HIST_BUCKET_COUNT; ++i){
+				window_samples += counters.histogram[i];
+			}
+			elem.window_samples = window_samples;
+			elem.ns_p50       = get_percentile(counters, window_samples, 500);
+			elem.ns_p90       = get_percentile(counters, window_samples, 900);
+			elem.ns_p99       = get_percentile(counters, window_samples, 990);
+			elem.ns_p999      = get_percentile(counters, window_samples, 999);
+			elem.ns_max       = counters.ns_max;
 			ret.push_back(elem);
 		}
 	}
@@ -99,7 +292,15 @@ std::vector<ProfileDepository::SnapshotElement> ProfileDepository::snapshot(){
 }
 void ProfileDepository::clear(){
 	const Mutex::UniqueLock lock(g_mutex);
-	g_profile.clear();
+	g_retired_profile.clear();
+	// 分片中的键可能正在被其所在的线程访问，只能清零。
+	for(AUTO(sit, g_shards.begin()); sit != g_shards.end(); ++sit){
+		const AUTO(shard, *sit);
+		const Mutex::UniqueLock shard_lock(shard->mutex);
+		for(AUTO(it, shard->profile.begin()); it != shard->profile.end(); ++it){
+			reset_counters(it->second);
+		}
+	}
 }
 
 }
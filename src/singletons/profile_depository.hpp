@@ -25,6 +25,15 @@ public:
 		unsigned long long ns_total;
 		// ns_total 扣除执行点位于其他 profiler 之中的纳秒数。
 		unsigned long long ns_exclusive;
+
+		// 以下数据来自每次采样的 ns_total 的直方图，只统计上次重置窗口以来的样本。
+		// 分位数是所在的桶的上界，相对误差不超过 12.5%。
+		unsigned long long window_samples;
+		unsigned long long ns_p50;
+		unsigned long long ns_p90;
+		unsigned long long ns_p99;
+		unsigned long long ns_p999;
+		unsigned long long ns_max;
 	};
 
 	static void start();
@@ -33,7 +42,8 @@ public:
 	static bool is_enabled();
 	static void accumulate(const char *file, unsigned long line, const char *func, double total, double exclusive) NOEXCEPT;
 
-	static std::vector<SnapshotElement> snapshot();
+	// 如果 reset_window 为 true，在读取直方图之后重置窗口。
+	static std::vector<SnapshotElement> snapshot(bool reset_window = false);
 	static void clear();
 };
 
@@ -88,7 +88,10 @@ namespace {
 				} else if(uri == "show_profile"){
 					CsvDocument csv;
 					boost::container::map<SharedNts, std::string> row;
-					AUTO(snapshot, ProfileDepository::snapshot());
+					// 带上 reset_window=1 或 reset_window=true 时，分位数统计在读取之后重新开始。
+					const AUTO_REF(reset_window_str, request_headers.get_params.get("reset_window"));
+					const bool reset_window = (reset_window_str == "1") || (::strcasecmp(reset_window_str.c_str(), "true") == 0);
+					AUTO(snapshot, ProfileDepository::snapshot(reset_window));
 					for(AUTO(it, snapshot.begin()); it != snapshot.end(); ++it){
 						row[sslit("file")] = it->file;
 						row[sslit("line")] = boost::lexical_cast<std::string>(it->line);
@@ -96,6 +99,12 @@ namespace {
 						row[sslit("samples")] = boost::lexical_cast<std::string>(it->samples);
 						row[sslit("ns_total")] = boost::lexical_cast<std::string>(it->ns_total);
 						row[sslit("ns_exclusive")] = boost::lexical_cast<std::string>(it->ns_exclusive);
+						row[sslit("window_samples")] = boost::lexical_cast<std::string>(it->window_samples);
+						row[sslit("ns_p50")] = boost::lexical_cast<std::string>(it->ns_p50);
+						row[sslit("ns_p90")] = boost::lexical_cast<std::string>(it->ns_p90);
+						row[sslit("ns_p99")] = boost::lexical_cast<std::string>(it->ns_p99);
+						row[sslit("ns_p999")] = boost::lexical_cast<std::string>(it->ns_p999);
+						row[sslit("ns_max")] = boost::lexical_cast<std::string>(it->ns_max);
 						if(csv.empty()){
 							csv.reset_headers(row);
 						}
@@ -17,21 +17,28 @@
 
 namespace Poseidon {
 
+namespace {
+	Mutex g_mutex;
+}
+
 struct TimerItem : NONCOPYABLE {
 	boost::uint64_t period;
 	boost::shared_ptr<const TimerCallback> callback;
 	bool low_level;
-	unsigned long stamp;
+
+	// 以下成员受 g_mutex 保护。
+	boost::weak_ptr<TimerItem> weak_self;
+	boost::uint64_t next;
+	TimerItem *wheel_next;
+	TimerItem **wheel_prev_next; // 为空表示不在时间轮中。
 
 	TimerItem(boost::uint64_t period_, boost::shared_ptr<const TimerCallback> callback_, bool low_level_)
 		: period(period_), callback(STD_MOVE(callback_)), low_level(low_level_)
-		, stamp(0)
+		, weak_self(), next(0), wheel_next(NULLPTR), wheel_prev_next(NULLPTR)
 	{
 		LOG_POSEIDON_DEBUG("Created timer: period = ", period, ", low_level = ", low_level);
 	}
-	~TimerItem(){
-		LOG_POSEIDON_DEBUG("Destroyed timer: period = ", period, ", low_level = ", low_level);
-	}
+	~TimerItem();
 };
 
 namespace {
@@ -62,95 +69,243 @@ namespace {
 		}
 	};
 
-	struct TimerQueueElement {
-		boost::uint64_t next;
-		boost::weak_ptr<TimerItem> item;
-		unsigned long stamp;
-
-		TimerQueueElement(boost::uint64_t next_, boost::weak_ptr<TimerItem> item_, unsigned long stamp_)
-			: next(next_), item(STD_MOVE(item_)), stamp(stamp_)
-		{
-		}
-
-		bool operator<(const TimerQueueElement &rhs) const {
-			return next > rhs.next;
-		}
+	// 分层时间轮，插入和删除都是 O(1) 的。计时器被销毁时立即从时间轮中移除。
+	// 最低一级有 256 个槽，每个槽 1 毫秒；以上每一级有 64 个槽，每个槽覆盖下一级一整圈的时间。
+	// 低一级转完一圈时，把高一级当前槽中的计时器重新分配到低层。超过 2^32 毫秒的计时器放在最高一级，届时重新分配。
+	enum {
+		ROOT_BITS    = 8,
+		ROOT_SIZE    = 1 << ROOT_BITS,
+		LEVEL_BITS   = 6,
+		LEVEL_SIZE   = 1 << LEVEL_BITS,
+		LEVEL_COUNT  = 4,
 	};
 
 	volatile bool g_running = false;
 	Thread g_thread;
 
-	Mutex g_mutex;
+	// 以下对象受 g_mutex 保护。
 	ConditionVariable g_new_timer;
-	std::vector<TimerQueueElement> g_timers;
+	boost::array<TimerItem *, ROOT_SIZE> g_wheel_root;
+	boost::array<boost::array<TimerItem *, LEVEL_SIZE>, LEVEL_COUNT> g_wheel_levels;
+	boost::uint64_t g_wheel_time = 0; // 下一个要处理的毫秒。
+	std::size_t g_timer_count = 0;
+	boost::uint64_t g_next_wakeup = 0; // 计时器线程睡眠到的时刻。
+
+	void push_to_slot(TimerItem *&slot, TimerItem *item) NOEXCEPT {
+		item->wheel_next = slot;
+		if(slot){
+			slot->wheel_prev_next = &(item->wheel_next);
+		}
+		item->wheel_prev_next = &slot;
+		slot = item;
+	}
+	void add_to_wheel(TimerItem *item) NOEXCEPT {
+		const AUTO(next, item->next);
+		if(next < g_wheel_time){
+			push_to_slot(g_wheel_root[g_wheel_time % ROOT_SIZE], item);
+			return;
+		}
+		const AUTO(delta, next - g_wheel_time);
+		if(delta < ROOT_SIZE){
+			push_to_slot(g_wheel_root[next % ROOT_SIZE], item);
+			return;
+		}
+		for(unsigned level = 0; level < LEVEL_COUNT - 1; ++level){
+			const unsigned shift = ROOT_BITS + LEVEL_BITS * level;
+			if(delta < (boost::uint64_t)1 << (shift + LEVEL_BITS)){
+				push_to_slot(g_wheel_levels[level][(next >> shift) % LEVEL_SIZE], item);
+				return;
+			}
+		}
+		const unsigned shift = ROOT_BITS + LEVEL_BITS * (LEVEL_COUNT - 1);
+		const AUTO(clamped, g_wheel_time + std::min<boost::uint64_t>(delta, 0xFFFFFFFFu));
+		push_to_slot(g_wheel_levels[LEVEL_COUNT - 1][(clamped >> shift) % LEVEL_SIZE], item);
+	}
 
-	bool pump_one_element() NOEXCEPT {
-		PROFILE_ME;
+	void link_timer(TimerItem *item, boost::uint64_t next) NOEXCEPT {
+		assert(!item->wheel_prev_next);
 
-		const AUTO(now, get_fast_mono_clock());
+		if(g_timer_count == 0){
+			g_wheel_time = get_fast_mono_clock();
+		}
+		item->next = next;
+		add_to_wheel(item);
+		++g_timer_count;
+		if(next < g_next_wakeup){
+			g_new_timer.signal();
+		}
+	}
+	void unlink_timer(TimerItem *item) NOEXCEPT {
+		if(!item->wheel_prev_next){
+			return;
+		}
+		*(item->wheel_prev_next) = item->wheel_next;
+		if(item->wheel_next){
+			item->wheel_next->wheel_prev_next = item->wheel_prev_next;
+		}
+		item->wheel_next = NULLPTR;
+		item->wheel_prev_next = NULLPTR;
+		--g_timer_count;
+	}
 
-		boost::shared_ptr<TimerItem> item;
-		{
-			const Mutex::UniqueLock lock(g_mutex);
-		_pick_next:
-			if(g_timers.empty()){
-				return false;
+	// 取出整个槽的链表。取出的链表必须在解锁之前处理完。
+	TimerItem *take_slot(TimerItem *&slot) NOEXCEPT {
+		const AUTO(head, slot);
+		slot = NULLPTR;
+		return head;
+	}
+	TimerItem *take_next(TimerItem *&head) NOEXCEPT {
+		const AUTO(item, head);
+		head = item->wheel_next;
+		item->wheel_next = NULLPTR;
+		item->wheel_prev_next = NULLPTR;
+		return item;
+	}
+
+	void cascade_wheel() NOEXCEPT {
+		for(unsigned level = 0; level < LEVEL_COUNT; ++level){
+			const unsigned shift = ROOT_BITS + LEVEL_BITS * level;
+			const std::size_t index = (g_wheel_time >> shift) % LEVEL_SIZE;
+			TimerItem *head = take_slot(g_wheel_levels[level][index]);
+			while(head){
+				add_to_wheel(take_next(head));
+			}
+			if(index != 0){
+				break;
 			}
-			if(now < g_timers.front().next){
-				return false;
+		}
+	}
+
+	// 推进时间轮直到 now（包含），把到期的计时器放入 expired。
+	void advance_wheel(std::vector<boost::shared_ptr<TimerItem> > &expired, boost::uint64_t now) NOEXCEPT {
+		if(g_timer_count == 0){
+			g_wheel_time = now + 1;
+			return;
+		}
+		while(g_wheel_time <= now){
+			const std::size_t index = g_wheel_time % ROOT_SIZE;
+			if(index == 0){
+				cascade_wheel();
 			}
-			std::pop_heap(g_timers.begin(), g_timers.end());
-			item = g_timers.back().item.lock();
-			if(!item || (item->stamp != g_timers.back().stamp)){
-				g_timers.pop_back();
-				goto _pick_next;
+			TimerItem *head = take_slot(g_wheel_root[index]);
+			// 此后重新加入的已经到期的计时器都会被放到下一毫秒的槽中。
+			++g_wheel_time;
+			while(head){
+				// 预留空间，这样 push_back() 不会抛出异常，也就不会在持有锁时释放计时器。
+				if(expired.size() == expired.capacity()){
+					try {
+						expired.reserve(expired.size() * 2 + 16);
+					} catch(std::bad_alloc &){
+						LOG_POSEIDON_ERROR("Out of memory while advancing timer wheel");
+						while(head){
+							add_to_wheel(take_next(head));
+						}
+						return;
+					}
+				}
+				const AUTO(item, take_next(head));
+				--g_timer_count;
+				// 正在析构的计时器会在析构函数中发现自己已经不在时间轮中了。
+				AUTO(shared, item->weak_self.lock());
+				if(!shared){
+					continue;
+				}
+				if(item->period != 0){
+					item->next = saturated_add(item->next, item->period);
+					add_to_wheel(item);
+					++g_timer_count;
+				}
+				expired.push_back(STD_MOVE_IDN(shared));
 			}
-			if(item->period == 0){
-				g_timers.pop_back();
-			} else {
-				g_timers.back().next = saturated_add(g_timers.back().next, item->period);
-				std::push_heap(g_timers.begin(), g_timers.end());
+		}
+	}
+
+	// 最低一级中最早的计时器。如果这一圈没有，返回下次重新分配的时刻，届时再计算。
+	// 返回值不会晚于任何计时器的到期时间，但可能更早。
+	boost::uint64_t get_next_expiry() NOEXCEPT {
+		if(g_timer_count == 0){
+			return (boost::uint64_t)-1;
+		}
+		const std::size_t begin = g_wheel_time % ROOT_SIZE;
+		if(begin == 0){
+			// 处理这一毫秒之前需要先重新分配。
+			return g_wheel_time;
+		}
+		for(std::size_t index = begin; index < ROOT_SIZE; ++index){
+			if(g_wheel_root[index]){
+				return g_wheel_time + (index - begin);
 			}
 		}
-		try {
-			if(item->low_level){
-				LOG_POSEIDON_TRACE("Dispatching async timer");
-				(*item->callback)(item, now, item->period);
-			} else {
-				LOG_POSEIDON_TRACE("Preparing a timer job for dispatching");
-				JobDispatcher::enqueue(boost::make_shared<TimerJob>(item, now), VAL_INIT);
+		return g_wheel_time + (ROOT_SIZE - begin);
+	}
+
+	bool pump_expired_timers() NOEXCEPT {
+		PROFILE_ME;
+
+		const AUTO(now, get_fast_mono_clock());
+
+		// 计时器必须在解锁之后才能被释放，因为析构函数需要锁定 g_mutex。
+		std::vector<boost::shared_ptr<TimerItem> > expired;
+		{
+			const Mutex::UniqueLock lock(g_mutex);
+			advance_wheel(expired, now);
+		}
+		for(AUTO(it, expired.begin()); it != expired.end(); ++it){
+			const AUTO_REF(item, *it);
+			try {
+				if(item->low_level){
+					LOG_POSEIDON_TRACE("Dispatching async timer");
+					(*item->callback)(item, now, item->period);
+				} else {
+					LOG_POSEIDON_TRACE("Preparing a timer job for dispatching");
+					JobDispatcher::enqueue(boost::make_shared<TimerJob>(item, now), VAL_INIT);
+				}
+			} catch(std::exception &e){
+				LOG_POSEIDON_WARNING("std::exception thrown while dispatching timer job, what = ", e.what());
+			} catch(...){
+				LOG_POSEIDON_WARNING("Unknown exception thrown while dispatching timer job.");
 			}
-		} catch(std::exception &e){
-			LOG_POSEIDON_WARNING("std::exception thrown while dispatching timer job, what = ", e.what());
-		} catch(...){
-			LOG_POSEIDON_WARNING("Unknown exception thrown while dispatching timer job.");
 		}
-		return true;
+		return !expired.empty();
 	}
 
 	void thread_proc(){
 		PROFILE_ME;
 		LOG_POSEIDON_INFO("Timer daemon started.");
 
-		unsigned timeout = 0;
 		for(;;){
 			bool busy;
 			do {
-				busy = pump_one_element();
-				timeout = std::min(timeout * 2u + 1u, !busy * 100u);
+				busy = pump_expired_timers();
 			} while(busy);
 
 			Mutex::UniqueLock lock(g_mutex);
 			if(!atomic_load(g_running, ATOMIC_CONSUME)){
 				break;
 			}
-			g_new_timer.timed_wait(lock, timeout);
+			// 睡眠到最近的计时器到期，注册更早的计时器时会唤醒这里。
+			const AUTO(now, get_fast_mono_clock());
+			g_next_wakeup = get_next_expiry();
+			if(g_next_wakeup == (boost::uint64_t)-1){
+				g_new_timer.wait(lock);
+			} else if(now < g_next_wakeup){
+				g_new_timer.timed_wait(lock, g_next_wakeup - now);
+			}
+			g_next_wakeup = 0;
 		}
 
 		LOG_POSEIDON_INFO("Timer daemon stopped.");
 	}
 }
 
+TimerItem::~TimerItem(){
+	{
+		const Mutex::UniqueLock lock(g_mutex);
+		unlink_timer(this);
+	}
+	LOG_POSEIDON_DEBUG("Destroyed timer: period = ", period, ", low_level = ", low_level);
+}
+
 void TimerDaemon::start(){
 	if(atomic_exchange(g_running, true, ATOMIC_ACQ_REL) != false){
 		LOG_POSEIDON_FATAL("Only one daemon is allowed at the same time.");
@@ -166,10 +321,30 @@ void TimerDaemon::stop(){
 	}
 	LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO, "Stopping timer daemon...");
 
+	{
+		const Mutex::UniqueLock lock(g_mutex);
+		g_new_timer.signal();
+	}
 	if(g_thread.joinable()){
 		g_thread.join();
 	}
-	g_timers.clear();
+
+	const Mutex::UniqueLock lock(g_mutex);
+	for(std::size_t index = 0; index < ROOT_SIZE; ++index){
+		TimerItem *head = take_slot(g_wheel_root[index]);
+		while(head){
+			take_next(head);
+		}
+	}
+	for(unsigned level = 0; level < LEVEL_COUNT; ++level){
+		for(std::size_t index = 0; index < LEVEL_SIZE; ++index){
+			TimerItem *head = take_slot(g_wheel_levels[level][index]);
+			while(head){
+				take_next(head);
+			}
+		}
+	}
+	g_timer_count = 0;
 }
 
 boost::shared_ptr<TimerItem> TimerDaemon::register_absolute_timer(
@@ -180,9 +355,8 @@ boost::shared_ptr<TimerItem> TimerDaemon::register_absolute_timer(
 	AUTO(item, boost::make_shared<TimerItem>(period, boost::make_shared<TimerCallback>(STD_MOVE_IDN(callback)), false));
 	{
 		const Mutex::UniqueLock lock(g_mutex);
-		g_timers.push_back(TimerQueueElement(time_point, item, item->stamp));
-		std::push_heap(g_timers.begin(), g_timers.end());
-		g_new_timer.signal();
+		item->weak_self = item;
+		link_timer(item.get(), time_point);
 	}
 	LOG_POSEIDON_DEBUG("Created a timer which will be triggered ", saturated_sub(time_point, get_fast_mono_clock()),
 		" microsecond(s) later and has a period of ", item->period, " microsecond(s).");
@@ -225,9 +399,8 @@ boost::shared_ptr<TimerItem> TimerDaemon::register_low_level_absolute_timer(
 	AUTO(item, boost::make_shared<TimerItem>(period, boost::make_shared<TimerCallback>(STD_MOVE_IDN(callback)), true));
 	{
 		const Mutex::UniqueLock lock(g_mutex);
-		g_timers.push_back(TimerQueueElement(time_point, item, item->stamp));
-		std::push_heap(g_timers.begin(), g_timers.end());
-		g_new_timer.signal();
+		item->weak_self = item;
+		link_timer(item.get(), time_point);
 	}
 	LOG_POSEIDON_DEBUG("Created a low level timer which will be triggered ", saturated_sub(time_point, get_fast_mono_clock()),
 		" microsecond(s) later and has a period of ", item->period, " microsecond(s).");
@@ -246,9 +419,8 @@ void TimerDaemon::set_absolute_time(const boost::shared_ptr<TimerItem> &item, bo
 	if(period != TimerDaemon::PERIOD_NOT_MODIFIED){
 		item->period = period;
 	}
-	g_timers.push_back(TimerQueueElement(time_point, item, ++item->stamp));
-	std::push_heap(g_timers.begin(), g_timers.end());
-	g_new_timer.signal();
+	unlink_timer(item.get());
+	link_timer(item.get(), time_point);
 }
 void TimerDaemon::set_time(const boost::shared_ptr<TimerItem> &item, boost::uint64_t first, boost::uint64_t period){
 	return set_absolute_time(item, saturated_add(get_fast_mono_clock(), first), period);
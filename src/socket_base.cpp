@@ -54,7 +54,7 @@ SocketBase::SocketBase(UniqueFile socket)
 	if(flags == -1){
 		DEBUG_THROW(SystemException);
 	}
-	if(::fcntl(m_socket.get(), F_SETFL, flags | O_NONBLOCK) != 0){
+	if(((flags & O_NONBLOCK) == 0) && (::fcntl(m_socket.get(), F_SETFL, flags | O_NONBLOCK) != 0)){
 		DEBUG_THROW(SystemException);
 	}
 }
@@ -169,4 +169,7 @@ void SocketBase::on_close(int err_code) NOEXCEPT {
 	(void)err_code;
 }
 
+void SocketBase::on_added_to_epoll(){
+}
+
 }
@@ -77,6 +77,9 @@ public:
 	virtual int poll_read_and_process(bool readable);
 	virtual int poll_write(Mutex::UniqueLock &write_lock, bool writeable);
 	virtual void on_close(int err_code) NOEXCEPT;
+
+	// 加入 epoll 之后调用。
+	virtual void on_added_to_epoll();
 };
 
 }
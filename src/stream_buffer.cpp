@@ -4,73 +4,275 @@
 #include "precompiled.hpp"
 #include "stream_buffer.hpp"
 #include "profiler.hpp"
+#include "log.hpp"
+#include "atomic.hpp"
 
 namespace Poseidon {
 
 namespace {
+	// 块按容量分级。小块用于零散的数据，大块用于大批量的收发，以减少链表节点数量。
+	enum {
+		SIZE_CLASS_COUNT = 3,
+		// 链表节点和存储分开分配，节点使用最后一个池。
+		NODE_POOL = SIZE_CLASS_COUNT,
+		POOL_COUNT,
+	};
+
+	const std::size_t g_chunk_capacities[SIZE_CLASS_COUNT] = { 0x100, 0x1000, 0x10000 };
+	// 每个线程缓存的空闲块数量上限，超出时将一半归还到全局池中。
+	const std::size_t g_thread_cache_limits[POOL_COUNT]    = { 256, 64, 8, 1024 };
+	// 全局池中的空闲块数量上限，超出时直接释放。
+	const std::size_t g_global_pool_limits[POOL_COUNT]     = { 4096, 1024, 64, 16384 };
+
+	unsigned choose_size_class(std::size_t hint) NOEXCEPT {
+		// 选择能容纳 hint 字节的最小的块，如果没有就选最大的。
+		unsigned size_class = 0;
+		while((size_class + 1 < SIZE_CLASS_COUNT) && (g_chunk_capacities[size_class] < hint)){
+			++size_class;
+		}
+		return size_class;
+	}
+
+	// 空闲块的第一个指针大小的空间用于保存下一个空闲块的地址。
+	void *&get_next_free(void *p) NOEXCEPT {
+		return *static_cast<void **>(p);
+	}
+
 	::pthread_mutex_t g_pool_mutex = PTHREAD_ERRORCHECK_MUTEX_INITIALIZER_NP;
-	void *g_pool_head = NULLPTR;
-}
+	void *g_pool_heads[POOL_COUNT];
+	std::size_t g_pool_counts[POOL_COUNT];
 
-struct StreamBuffer::Chunk FINAL {
-	static void *operator new(std::size_t bytes){
-		assert(bytes == sizeof(Chunk));
-		void *p;
+	// 线程缓存无需加锁。
+	__thread void *t_cache_heads[POOL_COUNT];
+	__thread std::size_t t_cache_counts[POOL_COUNT];
+	__thread bool t_cache_registered;
 
+	::pthread_once_t g_cache_key_once = PTHREAD_ONCE_INIT;
+	::pthread_key_t g_cache_key;
+
+	// 将一条长度为 count 的链表归还到全局池中，超出上限的部分直接释放。
+	void return_to_global_pool(unsigned pool, void *head, std::size_t count) NOEXCEPT {
 		int err_code = ::pthread_mutex_lock(&g_pool_mutex);
 		(void)err_code;
 		assert(err_code == 0);
-		try {
-			const AUTO(head, static_cast<Chunk *>(g_pool_head));
-			if(head){
-				g_pool_head = head->prev;
-				p = head;
-			} else {
-				p = ::operator new(bytes);
+		{
+			while(head && (g_pool_counts[pool] < g_global_pool_limits[pool])){
+				const AUTO(next, get_next_free(head));
+				get_next_free(head) = g_pool_heads[pool];
+				g_pool_heads[pool] = head;
+				++g_pool_counts[pool];
+				head = next;
+				--count;
 			}
-			err_code = ::pthread_mutex_unlock(&g_pool_mutex);
-			assert(err_code == 0);
-		} catch(...){
-			err_code = ::pthread_mutex_unlock(&g_pool_mutex);
-			assert(err_code == 0);
-			throw;
 		}
-		return p;
-	}
-	static void operator delete(void *p) NOEXCEPT {
-		if(!p){
-			return;
+		err_code = ::pthread_mutex_unlock(&g_pool_mutex);
+		assert(err_code == 0);
+
+		while(head){
+			const AUTO(next, get_next_free(head));
+			::operator delete(head);
+			head = next;
+			--count;
 		}
-		const AUTO(head, static_cast<Chunk *>(p));
+		assert(count == 0);
+	}
+	// 从全局池中批量取出一半的线程缓存上限数量的块。
+	void refill_from_global_pool(unsigned pool) NOEXCEPT {
+		const AUTO(batch, g_thread_cache_limits[pool] / 2);
 
 		int err_code = ::pthread_mutex_lock(&g_pool_mutex);
 		(void)err_code;
 		assert(err_code == 0);
 		{
-			head->prev = static_cast<Chunk *>(g_pool_head);
-			g_pool_head = head;
+			for(std::size_t i = 0; (i < batch) && g_pool_heads[pool]; ++i){
+				const AUTO(head, g_pool_heads[pool]);
+				g_pool_heads[pool] = get_next_free(head);
+				--g_pool_counts[pool];
+				get_next_free(head) = t_cache_heads[pool];
+				t_cache_heads[pool] = head;
+				++t_cache_counts[pool];
+			}
 		}
 		err_code = ::pthread_mutex_unlock(&g_pool_mutex);
 		assert(err_code == 0);
 	}
 
-	__attribute__((__destructor__(101)))
-	static void pool_destructor() NOEXCEPT {
-		for(;;){
-			const AUTO(head, static_cast<Chunk *>(g_pool_head));
+	void flush_thread_cache() NOEXCEPT {
+		for(unsigned pool = 0; pool < POOL_COUNT; ++pool){
+			const AUTO(head, t_cache_heads[pool]);
 			if(!head){
-				break;
+				continue;
 			}
-			g_pool_head = head->prev;
-			::operator delete(head);
+			const AUTO(count, t_cache_counts[pool]);
+			t_cache_heads[pool] = NULLPTR;
+			t_cache_counts[pool] = 0;
+			return_to_global_pool(pool, head, count);
+		}
+	}
+	void thread_cache_key_destructor(void *) NOEXCEPT {
+		flush_thread_cache();
+	}
+	void init_thread_cache_key() NOEXCEPT {
+		const int err_code = ::pthread_key_create(&g_cache_key, &thread_cache_key_destructor);
+		if(err_code != 0){
+			LOG_POSEIDON_FATAL("::pthread_key_create() failed with error code ", err_code);
+			std::abort();
 		}
 	}
+	// 线程退出时需要将线程缓存中的块归还到全局池中，否则这些块会泄漏。
+	void register_thread_cache() NOEXCEPT {
+		if(t_cache_registered){
+			return;
+		}
+		int err_code = ::pthread_once(&g_cache_key_once, &init_thread_cache_key);
+		if(err_code != 0){
+			LOG_POSEIDON_FATAL("::pthread_once() failed with error code ", err_code);
+			std::abort();
+		}
+		err_code = ::pthread_setspecific(g_cache_key, &t_cache_registered);
+		if(err_code != 0){
+			LOG_POSEIDON_FATAL("::pthread_setspecific() failed with error code ", err_code);
+			std::abort();
+		}
+		t_cache_registered = true;
+	}
+
+	void *allocate_block(unsigned pool, std::size_t bytes){
+		void *head = t_cache_heads[pool];
+		if(!head){
+			// 从全局池中取出的块放在线程缓存中，同样需要在线程退出时归还。
+			register_thread_cache();
+			refill_from_global_pool(pool);
+			head = t_cache_heads[pool];
+			if(!head){
+				return ::operator new(bytes);
+			}
+		}
+		t_cache_heads[pool] = get_next_free(head);
+		--t_cache_counts[pool];
+		return head;
+	}
+	void deallocate_block(unsigned pool, void *p) NOEXCEPT {
+		register_thread_cache();
+
+		get_next_free(p) = t_cache_heads[pool];
+		t_cache_heads[pool] = p;
+		++t_cache_counts[pool];
+		if(t_cache_counts[pool] <= g_thread_cache_limits[pool]){
+			return;
+		}
+
+		// 把一半摘下来归还到全局池中。
+		const AUTO(count, t_cache_counts[pool] / 2);
+		void *const head = t_cache_heads[pool];
+		void *tail = head;
+		for(std::size_t i = 1; i < count; ++i){
+			tail = get_next_free(tail);
+		}
+		t_cache_heads[pool] = get_next_free(tail);
+		t_cache_counts[pool] -= count;
+		get_next_free(tail) = NULLPTR;
+		return_to_global_pool(pool, head, count);
+	}
+
+	__attribute__((__destructor__(101)))
+	void pool_destructor() NOEXCEPT {
+		flush_thread_cache();
+
+		for(unsigned pool = 0; pool < POOL_COUNT; ++pool){
+			for(;;){
+				const AUTO(head, g_pool_heads[pool]);
+				if(!head){
+					break;
+				}
+				g_pool_heads[pool] = get_next_free(head);
+				::operator delete(head);
+			}
+			g_pool_counts[pool] = 0;
+		}
+	}
+
+	// 存储是引用计数的，多个块（可能属于不同的 StreamBuffer）可以共享同一段存储。
+	struct ChunkStorage {
+		volatile unsigned long ref_count;
+		unsigned size_class;
+		unsigned capacity;
+		unsigned char data[0];
+	};
+
+	ChunkStorage *create_storage(unsigned size_class){
+		assert(size_class < SIZE_CLASS_COUNT);
+
+		const AUTO(capacity, g_chunk_capacities[size_class]);
+		const AUTO(storage, static_cast<ChunkStorage *>(allocate_block(size_class, sizeof(ChunkStorage) + capacity)));
+		storage->ref_count = 1;
+		storage->size_class = size_class;
+		storage->capacity = static_cast<unsigned>(capacity);
+		return storage;
+	}
+	void retain_storage(ChunkStorage *storage) NOEXCEPT {
+		atomic_add(storage->ref_count, 1, ATOMIC_RELAXED);
+	}
+	void release_storage(ChunkStorage *storage) NOEXCEPT {
+		if(atomic_sub(storage->ref_count, 1, ATOMIC_ACQ_REL) != 0){
+			return;
+		}
+		deallocate_block(storage->size_class, storage);
+	}
+}
+
+struct StreamBuffer::Chunk FINAL {
+	static Chunk *create(unsigned size_class){
+		const AUTO(storage, create_storage(size_class));
+		Chunk *chunk;
+		try {
+			chunk = static_cast<Chunk *>(allocate_block(NODE_POOL, sizeof(Chunk)));
+		} catch(...){
+			release_storage(storage);
+			throw;
+		}
+		chunk->storage = storage;
+		chunk->data = storage->data;
+		chunk->capacity = storage->capacity;
+		return chunk;
+	}
+	// 创建一个与 src 共享存储的块，不复制数据。
+	static Chunk *create_shared(const Chunk *src){
+		const AUTO(chunk, static_cast<Chunk *>(allocate_block(NODE_POOL, sizeof(Chunk))));
+		retain_storage(src->storage);
+		chunk->begin = src->begin;
+		chunk->end = src->end;
+		chunk->storage = src->storage;
+		chunk->data = src->data;
+		chunk->capacity = src->capacity;
+		return chunk;
+	}
+	static void destroy(Chunk *chunk) NOEXCEPT {
+		if(!chunk){
+			return;
+		}
+		release_storage(chunk->storage);
+		deallocate_block(NODE_POOL, chunk);
+	}
 
 	Chunk *prev;
 	Chunk *next;
 	unsigned begin;
 	unsigned end;
-	unsigned char data[0x100];
+	ChunkStorage *storage;
+	unsigned char *data;
+	unsigned capacity;
+
+	// 共享的存储是只读的，只有独占存储的块才可以在头部或尾部写入。
+	bool is_exclusive() const NOEXCEPT {
+		return atomic_load(storage->ref_count, ATOMIC_ACQUIRE) == 1;
+	}
+	std::size_t get_head_avail() const NOEXCEPT {
+		return is_exclusive() ? begin : 0;
+	}
+	std::size_t get_tail_avail() const NOEXCEPT {
+		return is_exclusive() ? capacity - end : 0;
+	}
 };
 
 unsigned char *StreamBuffer::ChunkEnumerator::begin() const NOEXCEPT {
@@ -109,6 +311,29 @@ StreamBuffer::ConstChunkEnumerator &StreamBuffer::ConstChunkEnumerator::operator
 	return *this;
 }
 
+StreamBuffer::ReservedChunkEnumerator::ReservedChunkEnumerator(StreamBuffer &rhs) NOEXCEPT
+	: m_chunk(rhs.get_reserved_first())
+{
+}
+
+unsigned char *StreamBuffer::ReservedChunkEnumerator::begin() const NOEXCEPT {
+	assert(m_chunk);
+
+	return m_chunk->data + m_chunk->end;
+}
+unsigned char *StreamBuffer::ReservedChunkEnumerator::end() const NOEXCEPT {
+	assert(m_chunk);
+
+	return m_chunk->data + m_chunk->capacity;
+}
+
+StreamBuffer::ReservedChunkEnumerator &StreamBuffer::ReservedChunkEnumerator::operator++() NOEXCEPT {
+	assert(m_chunk);
+
+	m_chunk = m_chunk->next;
+	return *this;
+}
+
 // 构造函数和析构函数。
 StreamBuffer::StreamBuffer(const void *data, std::size_t bytes)
 	: m_first(NULLPTR), m_last(NULLPTR), m_size(0)
@@ -128,8 +353,27 @@ StreamBuffer::StreamBuffer(const std::string &str)
 StreamBuffer::StreamBuffer(const StreamBuffer &rhs)
 	: m_first(NULLPTR), m_last(NULLPTR), m_size(0)
 {
-	for(AUTO(ce, rhs.get_chunk_enumerator()); ce; ++ce){
-		put(ce.data(), ce.size());
+	// 复制时只增加存储的引用计数，不复制数据。
+	try {
+		for(AUTO(src, rhs.m_first); src; src = src->next){
+			if(src->begin == src->end){
+				continue;
+			}
+			const AUTO(chunk, Chunk::create_shared(src));
+			chunk->next = NULLPTR;
+			chunk->prev = m_last;
+
+			if(m_last){
+				m_last->next = chunk;
+			} else {
+				m_first = chunk;
+			}
+			m_last = chunk;
+			m_size += chunk->end - chunk->begin;
+		}
+	} catch(...){
+		clear();
+		throw;
 	}
 }
 StreamBuffer &StreamBuffer::operator=(const StreamBuffer &rhs){
@@ -152,6 +396,50 @@ StreamBuffer::~StreamBuffer(){
 }
 
 // 其他非静态成员函数。
+StreamBuffer::Chunk *StreamBuffer::get_reserved_first() const NOEXCEPT {
+	// 预留的空间包括最后一个非空块的尾部，以及之后所有的空块。
+	Chunk *first = NULLPTR;
+	AUTO(chunk, m_last);
+	while(chunk && (chunk->begin == chunk->end)){
+		first = chunk;
+		chunk = chunk->prev;
+	}
+	if(chunk && (chunk->get_tail_avail() != 0)){
+		first = chunk;
+	}
+	return first;
+}
+
+StreamBuffer::Chunk *StreamBuffer::get_exclusive_first(){
+	// 写时复制：把共享的块替换为独占的副本。
+	for(AUTO(chunk, m_first); chunk; chunk = chunk->next){
+		if(chunk->is_exclusive()){
+			continue;
+		}
+		const AUTO(bytes, chunk->end - chunk->begin);
+		const AUTO(copy, Chunk::create(choose_size_class(bytes)));
+		copy->begin = 0;
+		copy->end = bytes;
+		std::memcpy(copy->data, chunk->data + chunk->begin, bytes);
+
+		copy->prev = chunk->prev;
+		copy->next = chunk->next;
+		if(chunk->prev){
+			chunk->prev->next = copy;
+		} else {
+			m_first = copy;
+		}
+		if(chunk->next){
+			chunk->next->prev = copy;
+		} else {
+			m_last = copy;
+		}
+		Chunk::destroy(chunk);
+		chunk = copy;
+	}
+	return m_first;
+}
+
 int StreamBuffer::front() const NOEXCEPT {
 	if(m_size == 0){
 		return -1;
@@ -187,7 +475,7 @@ void StreamBuffer::clear() NOEXCEPT {
 	while(m_first){
 		const AUTO(chunk, m_first);
 		m_first = chunk->next;
-		delete chunk;
+		Chunk::destroy(chunk);
 	}
 	m_last = NULLPTR;
 	m_size = 0;
@@ -207,7 +495,7 @@ int StreamBuffer::get() NOEXCEPT {
 		}
 		if(chunk->begin == chunk->end){
 			chunk = chunk->next;
-			delete m_first;
+			Chunk::destroy(m_first);
 			m_first = chunk;
 
 			if(chunk){
@@ -223,13 +511,13 @@ int StreamBuffer::get() NOEXCEPT {
 void StreamBuffer::put(unsigned char by){
 	std::size_t last_avail = 0;
 	if(m_last){
-		last_avail = sizeof(m_last->data) - m_last->end;
+		last_avail = m_last->get_tail_avail();
 	}
 	Chunk *last_chunk = NULLPTR;
 	if(last_avail != 0){
 		last_chunk = m_last;
 	} else {
-		AUTO(chunk, new Chunk);
+		AUTO(chunk, Chunk::create(choose_size_class(m_size + 1)));
 		chunk->next = NULLPTR;
 		// chunk->prev = NULLPTR;
 		chunk->begin = 0;
@@ -267,7 +555,7 @@ int StreamBuffer::unput() NOEXCEPT {
 		}
 		if(chunk->begin == chunk->end){
 			chunk = chunk->prev;
-			delete m_last;
+			Chunk::destroy(m_last);
 			m_last = chunk;
 
 			if(chunk){
@@ -283,17 +571,17 @@ int StreamBuffer::unput() NOEXCEPT {
 void StreamBuffer::unget(unsigned char by){
 	std::size_t first_avail = 0;
 	if(m_first){
-		first_avail = m_first->begin;
+		first_avail = m_first->get_head_avail();
 	}
 	Chunk *first_chunk = NULLPTR;
 	if(first_avail != 0){
 		first_chunk = m_first;
 	} else {
-		AUTO(chunk, new Chunk);
+		AUTO(chunk, Chunk::create(0));
 		// chunk->next = NULLPTR;
 		chunk->prev = NULLPTR;
-		chunk->begin = sizeof(chunk->data);
-		chunk->end = sizeof(chunk->data);
+		chunk->begin = chunk->capacity;
+		chunk->end = chunk->capacity;
 
 		if(m_first){
 			m_first->prev = chunk;
@@ -347,7 +635,7 @@ std::size_t StreamBuffer::get(void *data, std::size_t bytes) NOEXCEPT {
 		chunk->begin += bytes_to_copy_this_time;
 		if(chunk->begin == chunk->end){
 			chunk = chunk->next;
-			delete m_first;
+			Chunk::destroy(m_first);
 			m_first = chunk;
 
 			if(chunk){
@@ -374,7 +662,7 @@ std::size_t StreamBuffer::discard(std::size_t bytes) NOEXCEPT {
 		chunk->begin += bytes_to_copy_this_time;
 		if(chunk->begin == chunk->end){
 			chunk = chunk->next;
-			delete m_first;
+			Chunk::destroy(m_first);
 			m_first = chunk;
 
 			if(chunk){
@@ -395,17 +683,19 @@ void StreamBuffer::put(const void *data, std::size_t bytes){
 
 	std::size_t last_avail = 0;
 	if(m_last){
-		last_avail = sizeof(m_last->data) - m_last->end;
+		last_avail = m_last->get_tail_avail();
 	}
 	Chunk *last_chunk = NULLPTR;
 	if(last_avail != 0){
 		last_chunk = m_last;
 	}
 	if(bytes_to_copy > last_avail){
-		const AUTO(new_chunks, (bytes_to_copy - last_avail - 1) / sizeof(last_chunk->data) + 1);
+		// 缓冲区中的数据越多，新分配的块就越大。
+		const AUTO(size_class, choose_size_class(std::max(bytes_to_copy - last_avail, m_size)));
+		const AUTO(new_chunks, (bytes_to_copy - last_avail - 1) / g_chunk_capacities[size_class] + 1);
 		assert(new_chunks != 0);
 
-		AUTO(chunk, new Chunk);
+		AUTO(chunk, Chunk::create(size_class));
 		chunk->next = NULLPTR;
 		chunk->prev = NULLPTR;
 		chunk->begin = 0;
@@ -414,7 +704,7 @@ void StreamBuffer::put(const void *data, std::size_t bytes){
 		AUTO(splice_first, chunk), splice_last = chunk;
 		try {
 			for(std::size_t i = 1; i < new_chunks; ++i){
-				chunk = new Chunk;
+				chunk = Chunk::create(size_class);
 				chunk->next = NULLPTR;
 				chunk->prev = splice_last;
 				chunk->begin = 0;
@@ -427,7 +717,7 @@ void StreamBuffer::put(const void *data, std::size_t bytes){
 			do {
 				chunk = splice_first;
 				splice_first = chunk->next;
-				delete chunk;
+				Chunk::destroy(chunk);
 			} while(splice_first);
 
 			throw;
@@ -449,7 +739,7 @@ void StreamBuffer::put(const void *data, std::size_t bytes){
 	AUTO(chunk, last_chunk);
 	do {
 		const AUTO(read, static_cast<const unsigned char *>(data) + bytes_copied);
-		const AUTO(bytes_to_copy_this_time, std::min<std::size_t>(bytes_to_copy - bytes_copied, sizeof(chunk->data) - chunk->end));
+		const AUTO(bytes_to_copy_this_time, std::min<std::size_t>(bytes_to_copy - bytes_copied, chunk->capacity - chunk->end));
 		std::memcpy(chunk->data + chunk->end, read, bytes_to_copy_this_time);
 		chunk->end += bytes_to_copy_this_time;
 		bytes_copied += bytes_to_copy_this_time;
@@ -464,6 +754,99 @@ void StreamBuffer::put(const std::string &str){
 	put(str.data(), str.size());
 }
 
+void StreamBuffer::reserve(std::size_t bytes){
+	std::size_t reserved_avail = 0;
+	for(AUTO(chunk, get_reserved_first()); chunk; chunk = chunk->next){
+		reserved_avail += chunk->capacity - chunk->end;
+	}
+	if(bytes <= reserved_avail){
+		return;
+	}
+	const AUTO(size_class, choose_size_class(std::max(bytes - reserved_avail, m_size)));
+	const AUTO(new_chunks, (bytes - reserved_avail - 1) / g_chunk_capacities[size_class] + 1);
+	assert(new_chunks != 0);
+
+	AUTO(chunk, Chunk::create(size_class));
+	chunk->next = NULLPTR;
+	chunk->prev = NULLPTR;
+	chunk->begin = 0;
+	chunk->end = 0;
+
+	AUTO(splice_first, chunk), splice_last = chunk;
+	try {
+		for(std::size_t i = 1; i < new_chunks; ++i){
+			chunk = Chunk::create(size_class);
+			chunk->next = NULLPTR;
+			chunk->prev = splice_last;
+			chunk->begin = 0;
+			chunk->end = 0;
+
+			splice_last->next = chunk;
+			splice_last = chunk;
+		}
+	} catch(...){
+		do {
+			chunk = splice_first;
+			splice_first = chunk->next;
+			Chunk::destroy(chunk);
+		} while(splice_first);
+
+		throw;
+	}
+	if(m_last){
+		m_last->next = splice_first;
+	} else {
+		m_first = splice_first;
+	}
+	splice_first->prev = m_last;
+	m_last = splice_last;
+}
+void StreamBuffer::commit(std::size_t bytes) NOEXCEPT {
+	std::size_t bytes_committed = 0;
+	AUTO(chunk, get_reserved_first());
+	while(bytes_committed < bytes){
+		assert(chunk);
+
+		const AUTO(bytes_to_commit_this_time, std::min<std::size_t>(bytes - bytes_committed, chunk->capacity - chunk->end));
+		chunk->end += bytes_to_commit_this_time;
+		bytes_committed += bytes_to_commit_this_time;
+		chunk = chunk->next;
+	}
+	m_size += bytes;
+
+	while(m_last && (m_last->begin == m_last->end)){
+		chunk = m_last->prev;
+		Chunk::destroy(m_last);
+		m_last = chunk;
+
+		if(chunk){
+			chunk->next = NULLPTR;
+		} else {
+			m_first = NULLPTR;
+		}
+	}
+
+	// 预留的块是按照请求的大小分配的。如果实际写入的数据很少，就复制到合适大小的块中，以免大块被长期占用。
+	if((bytes != 0) && m_last){
+		const AUTO(used, m_last->end - m_last->begin);
+		const AUTO(size_class, choose_size_class(used));
+		if(size_class < m_last->storage->size_class){
+			try {
+				const AUTO(storage, create_storage(size_class));
+				std::memcpy(storage->data, m_last->data + m_last->begin, used);
+				release_storage(m_last->storage);
+				m_last->storage = storage;
+				m_last->data = storage->data;
+				m_last->capacity = storage->capacity;
+				m_last->begin = 0;
+				m_last->end = used;
+			} catch(std::bad_alloc &){
+				// 保留原来的块。
+			}
+		}
+	}
+}
+
 StreamBuffer StreamBuffer::cut_off(std::size_t bytes){
 	StreamBuffer ret;
 
@@ -486,13 +869,19 @@ StreamBuffer StreamBuffer::cut_off(std::size_t bytes){
 			if(bytes_remaining == bytes_avail){
 				cut_end = cut_end->next;
 			} else {
-				const AUTO(chunk, new Chunk);
+				// 较大的数据共享存储；较小的数据直接复制，这样 cut_end 仍然独占其存储，之后可以继续在尾部写入。
+				Chunk *chunk;
+				if(bytes_remaining <= g_chunk_capacities[0]){
+					chunk = Chunk::create(0);
+					chunk->begin = 0;
+					chunk->end = static_cast<unsigned>(bytes_remaining);
+					std::memcpy(chunk->data, cut_end->data + cut_end->begin, bytes_remaining);
+				} else {
+					chunk = Chunk::create_shared(cut_end);
+					chunk->end = static_cast<unsigned>(chunk->begin + bytes_remaining);
+				}
 				chunk->next = cut_end;
 				chunk->prev = cut_end->prev;
-				chunk->begin = 0;
-				chunk->end = bytes_remaining;
-
-				std::memcpy(chunk->data, cut_end->data + cut_end->begin, bytes_remaining);
 				cut_end->begin += bytes_remaining;
 
 				if(cut_end->prev){
@@ -27,8 +27,9 @@ public:
 		Chunk *m_chunk;
 
 	public:
-		explicit ChunkEnumerator(StreamBuffer &rhs) NOEXCEPT
-			: m_chunk(rhs.m_first)
+		// 可写的枚举器会把共享的块复制一份，因此可能抛出异常。
+		explicit ChunkEnumerator(StreamBuffer &rhs)
+			: m_chunk(rhs.get_exclusive_first())
 		{
 		}
 
@@ -108,6 +109,45 @@ public:
 		}
 	};
 
+	// 遍历 reserve() 预留的可写空间。
+	class ReservedChunkEnumerator {
+	private:
+		Chunk *m_chunk;
+
+	public:
+		explicit ReservedChunkEnumerator(StreamBuffer &rhs) NOEXCEPT;
+
+	public:
+		unsigned char *begin() const NOEXCEPT;
+		unsigned char *end() const NOEXCEPT;
+
+		unsigned char *data() const NOEXCEPT {
+			return begin();
+		}
+		std::size_t size() const NOEXCEPT {
+			return static_cast<std::size_t>(end() - begin());
+		}
+
+	public:
+#ifdef POSEIDON_CXX11
+		explicit operator bool() const noexcept {
+			return !!m_chunk;
+		}
+#else
+		typedef bool (StreamBuffer::*DummyBool_)() const;
+		operator DummyBool_() const NOEXCEPT {
+			return !!m_chunk ? &StreamBuffer::empty : 0;
+		}
+#endif
+
+		ReservedChunkEnumerator &operator++() NOEXCEPT;
+		ReservedChunkEnumerator operator++(int) NOEXCEPT {
+			AUTO(ret, *this);
+			++*this;
+			return ret;
+		}
+	};
+
 	class ReadIterator : public std::iterator<std::input_iterator_tag, int> {
 	private:
 		StreamBuffer *m_owner;
@@ -163,6 +203,10 @@ private:
 	Chunk *m_last;
 	std::size_t m_size;
 
+private:
+	Chunk *get_reserved_first() const NOEXCEPT;
+	Chunk *get_exclusive_first();
+
 public:
 	CONSTEXPR StreamBuffer() NOEXCEPT
 		: m_first(NULLPTR), m_last(NULLPTR), m_size(0)
@@ -172,6 +216,7 @@ public:
 	StreamBuffer(const void *data, std::size_t bytes);
 	explicit StreamBuffer(const char *str);
 	explicit StreamBuffer(const std::string &str);
+	// 复制的对象与原对象共享存储，直到其中一方需要写入（写时复制）。
 	StreamBuffer(const StreamBuffer &rhs);
 	StreamBuffer &operator=(const StreamBuffer &rhs);
 #ifdef POSEIDON_CXX11
@@ -212,13 +257,21 @@ public:
 	ConstChunkEnumerator get_chunk_enumerator() const NOEXCEPT {
 		return ConstChunkEnumerator(*this);
 	}
-	ChunkEnumerator get_chunk_enumerator() NOEXCEPT {
+	ChunkEnumerator get_chunk_enumerator(){
 		return ChunkEnumerator(*this);
 	}
 	ConstChunkEnumerator get_const_chunk_enumerator() const NOEXCEPT {
 		return ConstChunkEnumerator(*this);
 	}
 
+	// 在末尾预留至少 bytes 字节的可写空间，预留的空间不计入 size()。
+	// 通过 get_reserved_chunk_enumerator() 直接写入之后，调用 commit() 将前 bytes 字节计入数据，其余的预留空间被释放。
+	void reserve(std::size_t bytes);
+	ReservedChunkEnumerator get_reserved_chunk_enumerator() NOEXCEPT {
+		return ReservedChunkEnumerator(*this);
+	}
+	void commit(std::size_t bytes) NOEXCEPT;
+
 	// 拆分成两部分，返回 [0, bytes) 部分，[bytes, -) 部分仍保存于当前对象中。
 	StreamBuffer cut_off(std::size_t bytes);
 	// cut_off() 的逆操作。该函数返回后 src 为空。
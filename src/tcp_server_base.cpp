@@ -11,6 +11,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <openssl/ssl.h>
 #include "singletons/main_config.hpp"
 #include "singletons/epoll_daemon.hpp"
@@ -30,15 +31,29 @@ namespace {
 		}
 	};
 
-	UniqueFile create_tcp_socket(const SockAddr &addr){
+	UniqueFile create_tcp_socket(const SockAddr &addr, bool reuse_port, int defer_accept){
 		UniqueFile tcp;
-		if(!tcp.reset(::socket(addr.get_family(), SOCK_STREAM, IPPROTO_TCP))){
+		if(!tcp.reset(::socket(addr.get_family(), SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP))){
 			DEBUG_THROW(SystemException);
 		}
 		static CONSTEXPR const int TRUE_VALUE = true;
 		if(::setsockopt(tcp.get(), SOL_SOCKET, SO_REUSEADDR, &TRUE_VALUE, sizeof(TRUE_VALUE)) != 0){
 			DEBUG_THROW(SystemException);
 		}
+		if(reuse_port){
+#ifdef SO_REUSEPORT
+			if(::setsockopt(tcp.get(), SOL_SOCKET, SO_REUSEPORT, &TRUE_VALUE, sizeof(TRUE_VALUE)) != 0){
+				DEBUG_THROW(SystemException);
+			}
+#else
+			DEBUG_THROW(SystemException, ENOPROTOOPT);
+#endif
+		}
+		if(defer_accept > 0){
+			if(::setsockopt(tcp.get(), IPPROTO_TCP, TCP_DEFER_ACCEPT, &defer_accept, sizeof(defer_accept)) != 0){
+				DEBUG_THROW(SystemException);
+			}
+		}
 		if(::bind(tcp.get(), static_cast<const ::sockaddr *>(addr.data()), addr.size()) != 0){
 			DEBUG_THROW(SystemException);
 		}
@@ -47,33 +62,82 @@ namespace {
 		}
 		return tcp;
 	}
+
+	std::size_t get_listener_count(){
+		const AUTO(count, MainConfig::get<std::size_t>("tcp_server_listener_count", 1));
+		return std::max<std::size_t>(count, 1);
+	}
+	int get_defer_accept(){
+		return MainConfig::get<int>("tcp_server_defer_accept", 0);
+	}
 }
 
+// 与 TcpServerBase 共享同一个端口的监听套接字，由各自所在的 epoll 线程接受连接。
+class TcpServerBase::ShardListener : public SocketBase {
+private:
+	boost::weak_ptr<const TcpServerBase> m_weak_server;
+
+public:
+	explicit ShardListener(UniqueFile socket)
+		: SocketBase(STD_MOVE(socket))
+	{
+	}
+
+public:
+	void set_server(boost::weak_ptr<const TcpServerBase> weak_server){
+		m_weak_server = STD_MOVE(weak_server);
+	}
+
+	int poll_read_and_process(bool readable) OVERRIDE {
+		PROFILE_ME;
+
+		(void)readable;
+
+		const AUTO(server, m_weak_server.lock());
+		if(!server){
+			return EPIPE;
+		}
+		return server->accept_clients(get_fd());
+	}
+};
+
 TcpServerBase::TcpServerBase(const SockAddr &addr, const char *cert, const char *private_key)
-	: SocketBase(create_tcp_socket(addr))
+	: SocketBase(create_tcp_socket(addr, get_listener_count() > 1, get_defer_accept()))
+	, m_accept_budget(MainConfig::get<unsigned>("tcp_server_accept_budget", 16))
 {
 	if(cert && *cert){
 		m_ssl_factory.reset(new ServerSslFactory(cert, private_key));
 	}
 
+	const AUTO(listener_count, get_listener_count());
+	if(listener_count > 1){
+		const AUTO(defer_accept, get_defer_accept());
+		m_shards.reserve(listener_count - 1);
+		for(std::size_t i = 1; i < listener_count; ++i){
+			m_shards.push_back(boost::make_shared<ShardListener>(create_tcp_socket(addr, true, defer_accept)));
+		}
+	}
+
 	LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO,
-		"Created TCP server on ", get_local_info(), ", SSL = ", !!m_ssl_factory);
+		"Created TCP server on ", get_local_info(), ", SSL = ", !!m_ssl_factory, ", listener_count = ", listener_count);
 }
 TcpServerBase::~TcpServerBase(){
 	LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO,
 		"Destroyed TCP server on ", get_local_info(), ", SSL = ", !!m_ssl_factory);
+
+	for(AUTO(it, m_shards.begin()); it != m_shards.end(); ++it){
+		(*it)->force_shutdown();
+	}
 }
 
-int TcpServerBase::poll_read_and_process(bool readable){
+int TcpServerBase::accept_clients(int listener) const {
 	PROFILE_ME;
 
-	(void)readable;
-
-	for(unsigned i = 0; i < 16; ++i){
+	for(unsigned i = 0; i < m_accept_budget; ++i){
 		boost::shared_ptr<TcpSessionBase> session;
 		try {
 			UniqueFile client;
-			if(!client.reset(::accept(get_fd(), NULLPTR, NULLPTR))){
+			if(!client.reset(::accept4(listener, NULLPTR, NULLPTR, SOCK_NONBLOCK | SOCK_CLOEXEC))){
 				return errno;
 			}
 			session = on_client_connect(STD_MOVE(client));
@@ -94,7 +158,7 @@ int TcpServerBase::poll_read_and_process(bool readable){
 				boost::scoped_ptr<SslFilterBase> filter(new SslFilter(STD_MOVE(ssl), session->get_fd()));
 				session->init_ssl(STD_MOVE(filter));
 			}
-			const AUTO(tcp_request_timeout, MainConfig::get<boost::uint64_t>("tcp_request_timeout", 5000));
+			const AUTO(tcp_request_timeout, MainConfig::get_snapshot().tcp_request_timeout);
 			session->set_timeout(tcp_request_timeout);
 			EpollDaemon::add_socket(session);
 			LOG_POSEIDON_INFO("Accepted TCP connection from ", session->get_remote_info());
@@ -107,4 +171,26 @@ int TcpServerBase::poll_read_and_process(bool readable){
 	return 0;
 }
 
+int TcpServerBase::poll_read_and_process(bool readable){
+	PROFILE_ME;
+
+	(void)readable;
+
+	return accept_clients(get_fd());
+}
+void TcpServerBase::on_added_to_epoll(){
+	PROFILE_ME;
+
+	for(AUTO(it, m_shards.begin()); it != m_shards.end(); ++it){
+		const AUTO_REF(shard, *it);
+		shard->set_server(virtual_weak_from_this<TcpServerBase>());
+		try {
+			EpollDaemon::add_socket(shard);
+		} catch(std::exception &e){
+			LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
+			shard->force_shutdown();
+		}
+	}
+}
+
 }
@@ -6,6 +6,7 @@
 
 #include <boost/shared_ptr.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <vector>
 #include "socket_base.hpp"
 #include "sock_addr.hpp"
 #include "ip_port.hpp"
@@ -17,19 +18,30 @@ class TcpSessionBase;
 
 // 抽象工厂模式
 class TcpServerBase : public SocketBase {
+private:
+	class ShardListener;
+
 private:
 	boost::scoped_ptr<ServerSslFactory> m_ssl_factory;
+	unsigned m_accept_budget;
+
+	// 使用 SO_REUSEPORT 时，除了自身以外的其他监听套接字。
+	std::vector<boost::shared_ptr<ShardListener> > m_shards;
 
 public:
 	explicit TcpServerBase(const SockAddr &addr, const char *cert = "", const char *private_key = "");
 	~TcpServerBase();
 
+private:
+	int accept_clients(int listener) const;
+
 protected:
 	// 工厂函数。返回空指针导致抛出一个异常。
 	virtual boost::shared_ptr<TcpSessionBase> on_client_connect(UniqueFile client) const = 0;
 
 public:
 	int poll_read_and_process(bool readable) OVERRIDE;
+	void on_added_to_epoll() OVERRIDE;
 };
 
 }
@@ -6,6 +6,7 @@
 #include "ssl_filter_base.hpp"
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include "singletons/epoll_daemon.hpp"
@@ -20,46 +21,84 @@
 
 namespace Poseidon {
 
-void TcpSessionBase::shutdown_timer_proc(const boost::weak_ptr<TcpSessionBase> &weak, boost::uint64_t now){
-	PROFILE_ME;
+namespace {
+	// 每次 readv() 预留的空间。
+	const std::size_t READ_RESERVE_SIZE = 16384;
+	const std::size_t READ_MAX_IOVECS = 256;
+	// 每次 poll_read_and_process() 最多读取的数据量。
+	const std::size_t READ_BUDGET = 262144;
 
-	const AUTO(session, weak.lock());
-	if(!session){
-		return;
-	}
+	const std::size_t WRITE_MAX_IOVECS = 256;
+	// 每次 poll_write() 最多写入的数据量。
+	const std::size_t WRITE_BUDGET = 1048576;
 
-	const AUTO(shutdown_time, atomic_load(session->m_shutdown_time, ATOMIC_CONSUME));
-	if(shutdown_time < now){
-		std::size_t send_buffer_size;
-		{
-			const Poseidon::Mutex::UniqueLock lock(session->m_send_mutex);
-			send_buffer_size = session->m_send_buffer.size();
+	// 全部会话共用一个计时器。会话按照截止时间分桶，计时器只检查到期的桶。
+	// 刷新最后活动时间只是一次原子写入，桶到期时没有超时的会话按照新的截止时间重新分桶。
+	const boost::uint64_t DEADLINE_GRANULARITY = 1000;
+
+	Mutex g_tracker_mutex;
+	boost::container::map<boost::uint64_t, std::vector<boost::weak_ptr<TcpSessionBase> > > g_deadline_buckets;
+	boost::shared_ptr<TimerItem> g_tracker_timer;
+}
+
+void TcpSessionBase::timeout_timer_proc(boost::uint64_t now){
+	PROFILE_ME;
+
+	std::vector<boost::shared_ptr<TcpSessionBase> > sessions;
+	{
+		const Mutex::UniqueLock lock(g_tracker_mutex);
+		while(!g_deadline_buckets.empty()){
+			const AUTO(it, g_deadline_buckets.begin());
+			if(now < it->first){
+				break;
+			}
+			for(AUTO(wit, it->second.begin()); wit != it->second.end(); ++wit){
+				AUTO(session, wit->lock());
+				if(!session){
+					continue;
+				}
+				// 会话被放入了更早的桶，这一项已经失效。
+				if(session->m_tracked_deadline != it->first){
+					continue;
+				}
+				atomic_store(session->m_tracked_deadline, (boost::uint64_t)-1, ATOMIC_RELAXED);
+				sessions.push_back(STD_MOVE_IDN(session));
+			}
+			g_deadline_buckets.erase(it);
 		}
-		if(send_buffer_size == 0){
-			LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_DEBUG,
-				"Connection closed due to inactivity: remote = ", session->get_remote_info());
-			session->set_timed_out();
+	}
+	for(AUTO(it, sessions.begin()); it != sessions.end(); ++it){
+		const AUTO_REF(session, *it);
+		try {
+			session->track_deadline(session->check_timeout(now));
+		} catch(std::exception &e){
+			LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
 			session->force_shutdown();
-			return;
 		}
-		LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_DEBUG,
-			"Shutdown pending: remote = ", session->get_remote_info(), ", send_buffer_size = ", send_buffer_size);
 	}
 
-	const AUTO(last_use_time, atomic_load(session->m_last_use_time, ATOMIC_CONSUME));
-	const AUTO(tcp_response_timeout, MainConfig::get<boost::uint64_t>("tcp_response_timeout", 30000));
-	if(saturated_add(last_use_time, tcp_response_timeout) < now){
-		LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_DEBUG,
-			"The connection seems dead: remote = ", session->get_remote_info());
-		session->force_shutdown();
-		return;
+	boost::shared_ptr<TimerItem> timer;
+	{
+		const Mutex::UniqueLock lock(g_tracker_mutex);
+		if(g_deadline_buckets.empty()){
+			timer.swap(g_tracker_timer);
+		}
+	}
+}
+
+void TcpSessionBase::stop_tracking_deadlines() NOEXCEPT {
+	boost::shared_ptr<TimerItem> timer;
+	{
+		const Mutex::UniqueLock lock(g_tracker_mutex);
+		g_deadline_buckets.clear();
+		timer.swap(g_tracker_timer);
 	}
 }
 
 TcpSessionBase::TcpSessionBase(UniqueFile socket)
 	: SocketBase(STD_MOVE(socket)), SessionBase()
 	, m_connected_notified(false), m_read_hup_notified(false)
-	, m_shutdown_time((boost::uint64_t)-1), m_last_use_time((boost::uint64_t)-1)
+	, m_shutdown_time((boost::uint64_t)-1), m_last_use_time((boost::uint64_t)-1), m_tracked_deadline((boost::uint64_t)-1)
 {
 }
 TcpSessionBase::~TcpSessionBase(){
@@ -68,15 +107,63 @@ TcpSessionBase::~TcpSessionBase(){
 void TcpSessionBase::init_ssl(Move<boost::scoped_ptr<SslFilterBase> > ssl_filter){
 	swap(m_ssl_filter, ssl_filter);
 }
-void TcpSessionBase::create_shutdown_timer(){
+void TcpSessionBase::track_deadline(boost::uint64_t deadline){
 	PROFILE_ME;
 
-	const Mutex::UniqueLock lock(m_shutdown_mutex);
-	if(m_shutdown_timer){
+	if(deadline == (boost::uint64_t)-1){
 		return;
 	}
-	m_shutdown_timer = TimerDaemon::register_low_level_timer(1000, 5000,
-		boost::bind(&shutdown_timer_proc, virtual_weak_from_this<TcpSessionBase>(), _2));
+	const AUTO(bucket, saturated_add(deadline, DEADLINE_GRANULARITY - 1) / DEADLINE_GRANULARITY * DEADLINE_GRANULARITY);
+	// 截止时间推迟时什么都不用做，等到原来的桶到期时再重新分桶。
+	if(atomic_load(m_tracked_deadline, ATOMIC_RELAXED) <= bucket){
+		return;
+	}
+	const Mutex::UniqueLock lock(g_tracker_mutex);
+	if(m_tracked_deadline <= bucket){
+		return;
+	}
+	g_deadline_buckets[bucket].push_back(virtual_weak_from_this<TcpSessionBase>());
+	atomic_store(m_tracked_deadline, bucket, ATOMIC_RELAXED);
+	if(!g_tracker_timer){
+		g_tracker_timer = TimerDaemon::register_low_level_timer(DEADLINE_GRANULARITY, DEADLINE_GRANULARITY,
+			boost::bind(&timeout_timer_proc, _2));
+	}
+}
+// 返回下一次需要检查的时间，如果会话已被关闭则返回 -1。
+boost::uint64_t TcpSessionBase::check_timeout(boost::uint64_t now){
+	PROFILE_ME;
+
+	const AUTO(shutdown_time, atomic_load(m_shutdown_time, ATOMIC_CONSUME));
+	if(shutdown_time < now){
+		std::size_t send_buffer_size;
+		{
+			const Poseidon::Mutex::UniqueLock lock(m_send_mutex);
+			send_buffer_size = m_send_buffer.size();
+		}
+		if(send_buffer_size == 0){
+			LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_DEBUG,
+				"Connection closed due to inactivity: remote = ", get_remote_info());
+			set_timed_out();
+			force_shutdown();
+			return (boost::uint64_t)-1;
+		}
+		LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_DEBUG,
+			"Shutdown pending: remote = ", get_remote_info(), ", send_buffer_size = ", send_buffer_size);
+	}
+
+	const AUTO(last_use_time, atomic_load(m_last_use_time, ATOMIC_CONSUME));
+	const AUTO(dead_time, saturated_add(last_use_time, MainConfig::get_snapshot().tcp_response_timeout));
+	if(dead_time < now){
+		LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_DEBUG,
+			"The connection seems dead: remote = ", get_remote_info());
+		force_shutdown();
+		return (boost::uint64_t)-1;
+	}
+
+	if(shutdown_time < now){
+		return std::min(saturated_add(now, DEADLINE_GRANULARITY), dead_time);
+	}
+	return std::min(shutdown_time, dead_time);
 }
 
 int TcpSessionBase::poll_read_and_process(bool readable){
@@ -84,36 +171,60 @@ int TcpSessionBase::poll_read_and_process(bool readable){
 
 	(void)readable;
 
-	std::vector<unsigned char> temp;
-
 	Poseidon::StreamBuffer data;
+	int err_code = 0;
 	try {
-		temp.resize(4096);
-		::ssize_t result;
-		if(m_ssl_filter){
-			result = m_ssl_filter->recv(temp.data(), temp.size());
-		} else {
-			result = ::recv(get_fd(), temp.data(), temp.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+		bool read_hup = false;
+		for(;;){
+			// 为了公平起见，每次最多读取 READ_BUDGET 字节，剩下的留到下一轮。
+			if(data.size() >= READ_BUDGET){
+				break;
+			}
+			data.reserve(READ_RESERVE_SIZE);
+
+			::ssize_t result;
+			if(m_ssl_filter){
+				const AUTO(ce, data.get_reserved_chunk_enumerator());
+				result = m_ssl_filter->recv(ce.data(), ce.size());
+			} else {
+				::iovec vecs[READ_MAX_IOVECS];
+				std::size_t count = 0;
+				for(AUTO(ce, data.get_reserved_chunk_enumerator()); ce && (count < COUNT_OF(vecs)); ++ce){
+					vecs[count].iov_base = ce.data();
+					vecs[count].iov_len = ce.size();
+					++count;
+				}
+				result = ::readv(get_fd(), vecs, static_cast<int>(count));
+			}
+			if(result < 0){
+				err_code = errno;
+				data.commit(0);
+				break;
+			}
+			if(result == 0){
+				data.commit(0);
+				read_hup = true;
+				break;
+			}
+			data.commit(static_cast<std::size_t>(result));
+			LOG_POSEIDON_TRACE("Read ", result, " byte(s) from ", get_remote_info());
 		}
-		if(result < 0){
-			return errno;
+		if(data.empty() && !read_hup){
+			return err_code;
 		}
-		temp.resize(static_cast<std::size_t>(result));
-		data.put(temp.data(), temp.size());
-		LOG_POSEIDON_TRACE("Read ", result, " byte(s) from ", get_remote_info());
 
 		const AUTO(now, get_fast_mono_clock());
 		atomic_store(m_last_use_time, now, ATOMIC_RELEASE);
-		create_shutdown_timer();
+		track_deadline(saturated_add(now, MainConfig::get_snapshot().tcp_response_timeout));
 
-		if(data.empty() && !m_read_hup_notified){
-			LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_DEBUG,
-				"TCP connection read hung up: local = ", get_local_info(), ", remote = ", get_remote_info());
-			shutdown_read();
-			on_read_hup();
-			m_read_hup_notified = true;
-		}
 		if(data.empty()){
+			if(!m_read_hup_notified){
+				LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_DEBUG,
+					"TCP connection read hung up: local = ", get_local_info(), ", remote = ", get_remote_info());
+				shutdown_read();
+				on_read_hup();
+				m_read_hup_notified = true;
+			}
 			return EWOULDBLOCK;
 		}
 		on_receive(STD_MOVE(data));
@@ -126,6 +237,10 @@ int TcpSessionBase::poll_read_and_process(bool readable){
 		force_shutdown();
 		return EPIPE;
 	}
+	// 如果读到了 EOF、出错或者超出了预算，需要再次调用。
+	if(err_code == EWOULDBLOCK){
+		return EWOULDBLOCK;
+	}
 	return 0;
 }
 int TcpSessionBase::poll_write(Mutex::UniqueLock &write_lock, bool writeable){
@@ -133,9 +248,8 @@ int TcpSessionBase::poll_write(Mutex::UniqueLock &write_lock, bool writeable){
 
 	assert(!write_lock);
 
-	std::vector<unsigned char> temp;
-
-	Poseidon::StreamBuffer data;
+	std::size_t bytes_written = 0;
+	int err_code = 0;
 	try {
 		if(writeable && !m_connected_notified){
 			LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_DEBUG,
@@ -144,42 +258,66 @@ int TcpSessionBase::poll_write(Mutex::UniqueLock &write_lock, bool writeable){
 			m_connected_notified = true;
 		}
 
-		temp.resize(4096);
-		Poseidon::Mutex::UniqueLock lock(m_send_mutex);
-		const std::size_t avail = m_send_buffer.peek(temp.data(), temp.size());
-		if(avail == 0){
-			if(should_really_shutdown_write()){
-				if(m_ssl_filter){
-					m_ssl_filter->send_fin();
-				} else {
-					::shutdown(get_fd(), SHUT_WR);
+		for(;;){
+			// 为了公平起见，每次最多写入 WRITE_BUDGET 字节，剩下的留到下一轮。
+			if(bytes_written >= WRITE_BUDGET){
+				break;
+			}
+
+			::ssize_t result;
+			Poseidon::Mutex::UniqueLock lock(m_send_mutex);
+			if(m_send_buffer.empty()){
+				if(should_really_shutdown_write()){
+					if(m_ssl_filter){
+						m_ssl_filter->send_fin();
+					} else {
+						::shutdown(get_fd(), SHUT_WR);
+					}
 				}
+				swap(write_lock, lock);
+				err_code = EWOULDBLOCK;
+				break;
 			}
-			return EWOULDBLOCK;
-		}
-		lock.unlock();
-		temp.resize(avail);
-
-		::ssize_t result;
-		if(m_ssl_filter){
-			result = m_ssl_filter->send(temp.data(), temp.size());
-		} else {
-			result = ::send(get_fd(), temp.data(), temp.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
-		}
-		if(result < 0){
-			return errno;
-		}
-		LOG_POSEIDON_TRACE("Wrote ", result, " byte(s) to ", get_remote_info());
+			if(m_ssl_filter){
+				// SSL 不支持 writev()，每次最多拷贝一个 TLS 记录的数据量。
+				unsigned char temp[16384];
+				const std::size_t avail = m_send_buffer.peek(temp, sizeof(temp));
+				lock.unlock();
 
-		const AUTO(now, get_fast_mono_clock());
-		atomic_store(m_last_use_time, now, ATOMIC_RELEASE);
-		create_shutdown_timer();
+				result = m_ssl_filter->send(temp, avail);
+			} else {
+				// 只有 epoll 线程会从发送缓冲区中移除数据，其他线程只会在末尾追加，因此解锁之后这些块仍然有效。
+				::iovec vecs[WRITE_MAX_IOVECS];
+				std::size_t count = 0;
+				for(AUTO(ce, m_send_buffer.get_const_chunk_enumerator()); ce && (count < COUNT_OF(vecs)); ++ce){
+					if(ce.size() == 0){
+						continue;
+					}
+					vecs[count].iov_base = const_cast<unsigned char *>(ce.data());
+					vecs[count].iov_len = ce.size();
+					++count;
+				}
+				lock.unlock();
 
-		lock.lock();
-		m_send_buffer.discard(static_cast<std::size_t>(result));
-		swap(write_lock, lock);
-		if(m_send_buffer.empty()){
-			return EWOULDBLOCK;
+				::msghdr msg = { };
+				msg.msg_iov = vecs;
+				msg.msg_iovlen = count;
+				result = ::sendmsg(get_fd(), &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+			}
+			if(result < 0){
+				err_code = errno;
+				break;
+			}
+			LOG_POSEIDON_TRACE("Wrote ", result, " byte(s) to ", get_remote_info());
+			bytes_written += static_cast<std::size_t>(result);
+
+			lock.lock();
+			m_send_buffer.discard(static_cast<std::size_t>(result));
+		}
+		if(bytes_written != 0){
+			const AUTO(now, get_fast_mono_clock());
+			atomic_store(m_last_use_time, now, ATOMIC_RELEASE);
+			track_deadline(saturated_add(now, MainConfig::get_snapshot().tcp_response_timeout));
 		}
 	} catch(std::exception &e){
 		LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
@@ -190,7 +328,7 @@ int TcpSessionBase::poll_write(Mutex::UniqueLock &write_lock, bool writeable){
 		force_shutdown();
 		return EPIPE;
 	}
-	return 0;
+	return err_code;
 }
 
 bool TcpSessionBase::is_throttled() const {
@@ -213,8 +351,9 @@ void TcpSessionBase::set_timeout(boost::uint64_t timeout){
 	PROFILE_ME;
 
 	const AUTO(now, get_fast_mono_clock());
-	atomic_store(m_shutdown_time, saturated_add(now, timeout), ATOMIC_RELEASE);
-	create_shutdown_timer();
+	const AUTO(shutdown_time, saturated_add(now, timeout));
+	atomic_store(m_shutdown_time, shutdown_time, ATOMIC_RELEASE);
+	track_deadline(shutdown_time);
 }
 
 bool TcpSessionBase::send(StreamBuffer buffer){
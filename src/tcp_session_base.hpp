@@ -14,13 +14,16 @@ namespace Poseidon {
 
 class TcpServerBase;
 class SslFilterBase;
-class TimerItem;
 
 class TcpSessionBase : public SocketBase, public SessionBase {
 	friend TcpServerBase;
 
 private:
-	static void shutdown_timer_proc(const boost::weak_ptr<TcpSessionBase> &weak, boost::uint64_t now);
+	static void timeout_timer_proc(boost::uint64_t now);
+
+public:
+	// 由 EpollDaemon::stop() 调用，释放超时检查计时器。
+	static void stop_tracking_deadlines() NOEXCEPT;
 
 private:
 	boost::scoped_ptr<SslFilterBase> m_ssl_filter;
@@ -33,8 +36,8 @@ private:
 
 	volatile boost::uint64_t m_shutdown_time;
 	volatile boost::uint64_t m_last_use_time;
-	mutable Mutex m_shutdown_mutex;
-	boost::shared_ptr<TimerItem> m_shutdown_timer;
+	// 所在的超时检查桶，全部会话共用一个计时器，参见 tcp_session_base.cpp。
+	volatile boost::uint64_t m_tracked_deadline;
 
 public:
 	explicit TcpSessionBase(UniqueFile socket);
@@ -42,7 +45,8 @@ public:
 
 protected:
 	void init_ssl(Move<boost::scoped_ptr<SslFilterBase> > ssl_filter);
-	void create_shutdown_timer();
+	void track_deadline(boost::uint64_t deadline);
+	boost::uint64_t check_timeout(boost::uint64_t now);
 
 	// 注意，只能在 epoll 线程中调用这些函数。
 	int poll_read_and_process(bool readable) OVERRIDE;
@@ -101,7 +101,7 @@ namespace WebSocket {
 			LOG_POSEIDON_DEBUG("Dispatching data message: opcode = ", m_opcode, ", payload_size = ", m_payload.size());
 			session->on_sync_data_message(m_opcode, STD_MOVE(m_payload));
 
-			const AUTO(keep_alive_timeout, MainConfig::get<boost::uint64_t>("websocket_keep_alive_timeout", 30000));
+			const AUTO(keep_alive_timeout, MainConfig::get_snapshot().websocket_keep_alive_timeout);
 			session->set_timeout(keep_alive_timeout);
 		}
 	};
@@ -125,14 +125,14 @@ namespace WebSocket {
 			LOG_POSEIDON_DEBUG("Dispatching control message: opcode = ", m_opcode, ", payload_size = ", m_payload.size());
 			session->on_sync_control_message(m_opcode, STD_MOVE(m_payload));
 
-			const AUTO(keep_alive_timeout, MainConfig::get<boost::uint64_t>("websocket_keep_alive_timeout", 30000));
+			const AUTO(keep_alive_timeout, MainConfig::get_snapshot().websocket_keep_alive_timeout);
 			session->set_timeout(keep_alive_timeout);
 		}
 	};
 
 	Session::Session(const boost::shared_ptr<Http::LowLevelSession> &parent)
 		: LowLevelSession(parent)
-		, m_max_request_length(MainConfig::get<boost::uint64_t>("websocket_max_request_length", 16384))
+		, m_max_request_length(MainConfig::get_snapshot().websocket_max_request_length)
 		, m_size_total(0), m_opcode(OP_INVALID)
 	{
 	}